@@ -1,20 +1,73 @@
 #include <SDL.h>
+#ifdef _WIN32
 #include <windows.h>
+#include <conio.h> // For _kbhit and _getch
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+#include <linux/uinput.h>
+#endif
 #include <iostream>
 #include <vector>
 #include <set>
+#include <unordered_map>
+#include <map>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <queue>
 #include <chrono>
 #include <algorithm>
+#include <array>
+#include <functional>
 #include <fstream>
 #include <limits>
+#include <climits>
 #include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
 #include <sstream>
-#include <conio.h> // For _kbhit and _getch
+#include <cstdint>
+#include <cstdio>
+#include <charconv>
+#include <ctime>
+#include <random>
+#include <sys/stat.h>
 #include "nlohmann/json.hpp"
 
-nlohmann::json translations; // Global translation object
+#ifndef _WIN32
+// Console colours use the Windows attribute bits on every platform
+// (the Linux console maps them to ANSI colours)
+typedef unsigned short WORD;
+#define FOREGROUND_BLUE      0x0001
+#define FOREGROUND_GREEN     0x0002
+#define FOREGROUND_RED       0x0004
+#define FOREGROUND_INTENSITY 0x0008
+// Windows virtual-key codes; profiles store these, so they are used on every platform
+#define VK_TAB     0x09
+#define VK_RETURN  0x0D
+#define VK_ESCAPE  0x1B
+#define VK_SPACE   0x20
+#define VK_LEFT    0x25
+#define VK_UP      0x26
+#define VK_RIGHT   0x27
+#define VK_DOWN    0x28
+#define VK_LSHIFT  0xA0
+#define VK_RSHIFT  0xA1
+#define VK_OEM_4   0xDB // [
+#endif
 
 #define FOREGROUND_YELLOW   (FOREGROUND_RED | FOREGROUND_GREEN)
 #define FOREGROUND_CYAN     (FOREGROUND_GREEN | FOREGROUND_BLUE)
@@ -32,381 +85,3305 @@ nlohmann::json translations; // Global translation object
 #define COLOR_PROMPT       (FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY)
 #define COLOR_PINK         (FOREGROUND_RED | FOREGROUND_BLUE | FOREGROUND_INTENSITY)
 
-// Helper to send mouse scroll
-void sendMouseScroll(int amount) {
-    INPUT input = {0};
-    input.type = INPUT_MOUSE;
-    input.mi.dwFlags = MOUSEEVENTF_WHEEL;
-    input.mi.mouseData = amount;
-    SendInput(1, &input, sizeof(INPUT));
-}
+// ---------------------------------------------------------------------------
+// Platform layer. Everything OS-specific sits behind these interfaces so the
+// decode/debounce/output engine is the same on Windows and Linux.
+// ---------------------------------------------------------------------------
 
-// Helper to send arrow key presses
-void sendArrowKey(int key, int hold_ms) {
-    INPUT input = {0};
-    input.type = INPUT_KEYBOARD;
-    input.ki.wVk = key;
-    input.ki.dwFlags = 0;
-    SendInput(1, &input, sizeof(INPUT));
+// Key codes returned by Console::getch() on every platform
+const int KEY_CODE_ENTER = 13;
+const int KEY_CODE_BACKSPACE = 8;
+const int KEY_CODE_TAB = 9;
+const int KEY_CODE_ESC = 27;
 
-    // Sleep to simulate key press duration
-    std::this_thread::sleep_for(std::chrono::milliseconds(hold_ms));
+// Text console: colours, clearing, single-key reads
+class Console {
+public:
+    virtual ~Console() {}
+    virtual void write_colored(const std::string& text, WORD color) = 0;
+    virtual void clear() = 0;
+    virtual void set_title(const std::string& title) = 0;
+    virtual bool kbhit() = 0;
+    virtual int getch() = 0;
+    // Raw mode: keys are readable one at a time without Enter or echo
+    // (needed for kbhit/getch on terminals; a no-op on the Windows console)
+    virtual void set_raw(bool raw) = 0;
+};
 
-    // Release the key
-    input.ki.dwFlags = KEYEVENTF_KEYUP;
-    SendInput(1, &input, sizeof(INPUT));
-}
+enum class OutputKind { KeyDown, KeyUp, Scroll };
 
-// Helper to match the largest subset first
-int match_combo(const std::set<int>& pressed, const std::vector<std::set<int>>& combos) {
-    int best = -1;
-    int best_size = -1;
-    for (size_t i = 0; i < combos.size(); ++i) {
-        const auto& combo = combos[i];
-        if (std::includes(pressed.begin(), pressed.end(), combo.begin(), combo.end())) {
-            if ((int)combo.size() > best_size) {
-                best = (int)i;
-                best_size = (int)combo.size();
+// One event of a batch handed to OutputSink::send_batch
+struct SinkEvent {
+    OutputKind kind;
+    int code; // virtual-key code, or wheel amount for Scroll
+    bool scancode;
+};
+
+// Where translated key and wheel events go. Key codes are Windows
+// virtual-key codes; wheel amounts use the Windows 120-per-notch convention.
+class OutputSink {
+public:
+    virtual ~OutputSink() {}
+    // scancode = true sends the hardware scan code, which some games require
+    virtual void key_event(int vk, bool key_up, bool scancode) = 0;
+    virtual void scroll(int amount) = 0;
+    // Several events back to back; platforms override this to hand them to
+    // the OS in one call
+    virtual void send_batch(const std::vector<SinkEvent>& events) {
+        for (const auto& ev : events) {
+            if (ev.kind == OutputKind::Scroll) scroll(ev.code);
+            else key_event(ev.code, ev.kind == OutputKind::KeyUp, ev.scancode);
+        }
+    }
+};
+
+enum HotkeyAction { HOTKEY_NONE, HOTKEY_SETTINGS, HOTKEY_EXIT };
+
+// Tab/Esc hotkeys, only honoured while the translator's console has focus
+class Hotkeys {
+public:
+    virtual ~Hotkeys() {}
+    virtual HotkeyAction poll() = 0;
+};
+
+// What identifies the window that has keyboard focus
+struct WindowIdentity {
+    std::string window_class;
+    std::string title;
+    std::string exe; // file name of the owning executable, without a path
+    bool operator==(const WindowIdentity& o) const { return window_class == o.window_class && title == o.title && exe == o.exe; }
+    bool operator!=(const WindowIdentity& o) const { return !(*this == o); }
+};
+
+// The focused window, for switching profiles per game
+class ForegroundWindow {
+public:
+    virtual ~ForegroundWindow() {}
+    // false if the focused window is unknown
+    virtual bool identity(WindowIdentity& window) = 0;
+};
+
+// Change notifications for the files in the working directory (where the
+// profiles live)
+class FileWatcher {
+public:
+    virtual ~FileWatcher() {}
+    // Blocks until something changed and fills 'names' with the files
+    // involved; an empty name means the OS dropped events and any file may
+    // have changed. Returns false once stop() has been called.
+    virtual bool wait(std::vector<std::string>& names) = 0;
+    // Wakes wait() from another thread
+    virtual void stop() = 0;
+};
+
+// Local control endpoint for the headless mode: one client at a time,
+// plain byte stream
+class ControlServer {
+public:
+    virtual ~ControlServer() {}
+    virtual bool listen(const std::string& endpoint) = 0;
+    // Blocks until a client connects; false once stop() has been called
+    virtual bool accept() = 0;
+    // Blocks for data from the client: bytes read, 0 when it disconnected,
+    // -1 once stop() has been called
+    virtual int read(char* buf, int size) = 0;
+    virtual bool write(const std::string& data) = 0;
+    virtual void disconnect() = 0;
+    // Wakes accept()/read() from another thread
+    virtual void stop() = 0;
+};
+
+#ifdef _WIN32
+class Win32Console : public Console {
+public:
+    void write_colored(const std::string& text, WORD color) override {
+        HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+        CONSOLE_SCREEN_BUFFER_INFO info;
+        GetConsoleScreenBufferInfo(hConsole, &info);
+        WORD original = info.wAttributes;
+        // Do not remap any colors; always use the color provided
+        SetConsoleTextAttribute(hConsole, color);
+        std::cout << text;
+        SetConsoleTextAttribute(hConsole, original);
+    }
+    void clear() override { system("cls"); }
+    void set_title(const std::string& title) override { SetConsoleTitleA(title.c_str()); }
+    bool kbhit() override { return _kbhit() != 0; }
+    int getch() override { return _getch(); }
+    void set_raw(bool) override {}
+};
+
+class Win32OutputSink : public OutputSink {
+public:
+    void key_event(int vk, bool key_up, bool scancode) override {
+        INPUT input = key_input(vk, key_up, scancode);
+        SendInput(1, &input, sizeof(INPUT));
+    }
+    void scroll(int amount) override {
+        INPUT input = wheel_input(amount);
+        SendInput(1, &input, sizeof(INPUT));
+    }
+    // One SendInput call, so nothing else can be injected in between
+    void send_batch(const std::vector<SinkEvent>& events) override {
+        std::vector<INPUT> inputs;
+        inputs.reserve(events.size());
+        for (const auto& ev : events) {
+            if (ev.kind == OutputKind::Scroll) inputs.push_back(wheel_input(ev.code));
+            else inputs.push_back(key_input(ev.code, ev.kind == OutputKind::KeyUp, ev.scancode));
+        }
+        if (!inputs.empty()) SendInput((UINT)inputs.size(), inputs.data(), sizeof(INPUT));
+    }
+
+private:
+    static INPUT key_input(int vk, bool key_up, bool scancode) {
+        INPUT input = {0};
+        input.type = INPUT_KEYBOARD;
+        input.ki.wVk = vk;
+        if (scancode) {
+            input.ki.wScan = MapVirtualKey(vk, MAPVK_VK_TO_VSC);
+            input.ki.dwFlags = KEYEVENTF_SCANCODE;
+            input.ki.dwExtraInfo = GetMessageExtraInfo();
+        }
+        if (key_up) input.ki.dwFlags |= KEYEVENTF_KEYUP;
+        return input;
+    }
+    static INPUT wheel_input(int amount) {
+        INPUT input = {0};
+        input.type = INPUT_MOUSE;
+        input.mi.dwFlags = MOUSEEVENTF_WHEEL;
+        input.mi.mouseData = amount;
+        return input;
+    }
+};
+
+class Win32Hotkeys : public Hotkeys {
+public:
+    Win32Hotkeys() : consoleWnd(GetConsoleWindow()), parentWnd(GetParent(consoleWnd)) {}
+    HotkeyAction poll() override {
+        HWND fgWnd = GetForegroundWindow();
+        if (fgWnd != consoleWnd && fgWnd != parentWnd) return HOTKEY_NONE;
+        if (GetAsyncKeyState(VK_ESCAPE) & 0x8000) return HOTKEY_EXIT;
+        if (GetAsyncKeyState(VK_TAB) & 0x8000) return HOTKEY_SETTINGS;
+        return HOTKEY_NONE;
+    }
+private:
+    HWND consoleWnd;
+    HWND parentWnd;
+};
+
+class Win32ForegroundWindow : public ForegroundWindow {
+public:
+    bool identity(WindowIdentity& window) override {
+        HWND hwnd = GetForegroundWindow();
+        if (!hwnd) return false;
+        char buf[MAX_PATH];
+        // Class and executable only change with the window itself
+        if (hwnd != last_hwnd) {
+            last_hwnd = hwnd;
+            cached.window_class = GetClassNameA(hwnd, buf, sizeof(buf)) > 0 ? buf : "";
+            cached.exe.clear();
+            DWORD pid = 0;
+            GetWindowThreadProcessId(hwnd, &pid);
+            if (HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid)) {
+                DWORD size = sizeof(buf);
+                if (QueryFullProcessImageNameA(process, 0, buf, &size)) {
+                    std::string path(buf, size);
+                    cached.exe = path.substr(path.find_last_of("\\/") + 1);
+                }
+                CloseHandle(process);
             }
         }
+        cached.title = GetWindowTextA(hwnd, buf, sizeof(buf)) > 0 ? buf : "";
+        window = cached;
+        return true;
     }
-    return best;
-}
+private:
+    HWND last_hwnd = nullptr;
+    WindowIdentity cached;
+};
 
-// Config structure and defaults
-struct Config {
-    int debounce_ms = 30;
-    int up_down_delay_ms = 25;
-    int mouse_scroll_delay_ms = 20;
-    int key_hold_time_ms = 10; // New: how long to hold arrow key down (ms)
-    int last_mode = 0;
-    int last_joystick = 0;
-    std::string language = "en";
-    std::string profile = "Default"; // Profile name
-    // Lever mapping: 15 positions, each a set of button indices
-    std::vector<std::set<int>> lever_mappings;
-    // Optional pedal mappings
-    int big_horn_button = -1; // -1 = not set
-    int small_horn_button = -1; // -1 = not set
-    int credit_button = -1;    // -1 = not set (LeftShift+C)
-    int test_menu_button = -1; // -1 = not set (RightShift)
-    int debug_mission_button = -1; // -1 = not set (LeftShift)
-    std::vector<int> lever_keycodes; // New: keycode for each lever position (mode 2)
-    Config() {
-        // Default lever mapping (original ordered_combos)
-        lever_mappings = {
-            {9}, {8}, {8,9}, {7}, {7,9}, {7,8}, {7,8,9}, {6}, {6,9}, {6,8},
-            {6,8,9}, {6,7}, {6,7,9}, {6,7,8}, {6,7,8,9}
-        };
-        big_horn_button = -1;
-        small_horn_button = -1;
-        credit_button = -1;
-        test_menu_button = -1;
-        debug_mission_button = -1;
-        language = "en";
-        profile = "Default";
-        lever_keycodes = std::vector<int>(15, 0); // Default: all 0 (no key)
+// Named pipe with overlapped I/O; stop() signals a second event so a
+// pending connect or read can be abandoned
+class Win32PipeControlServer : public ControlServer {
+public:
+    Win32PipeControlServer() : io_event(CreateEventA(nullptr, TRUE, FALSE, nullptr)), stopped(CreateEventA(nullptr, TRUE, FALSE, nullptr)) {}
+    ~Win32PipeControlServer() {
+        if (pipe != INVALID_HANDLE_VALUE) CloseHandle(pipe);
+        if (io_event) CloseHandle(io_event);
+        if (stopped) CloseHandle(stopped);
+    }
+    bool listen(const std::string& endpoint) override {
+        if (!io_event || !stopped) return false;
+        pipe = CreateNamedPipeA(endpoint.c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+                                PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1, 4096, 4096, 0, nullptr);
+        return pipe != INVALID_HANDLE_VALUE;
+    }
+    bool accept() override {
+        OVERLAPPED ov = {};
+        ov.hEvent = io_event;
+        ResetEvent(io_event);
+        if (ConnectNamedPipe(pipe, &ov)) return true;
+        DWORD err = GetLastError();
+        if (err == ERROR_PIPE_CONNECTED) return true;
+        if (err != ERROR_IO_PENDING) return false;
+        DWORD bytes = 0;
+        return finish(ov, bytes);
     }
+    int read(char* buf, int size) override {
+        OVERLAPPED ov = {};
+        ov.hEvent = io_event;
+        ResetEvent(io_event);
+        DWORD bytes = 0;
+        if (!ReadFile(pipe, buf, (DWORD)size, nullptr, &ov) && GetLastError() != ERROR_IO_PENDING) return 0;
+        if (!finish(ov, bytes)) return WaitForSingleObject(stopped, 0) == WAIT_OBJECT_0 ? -1 : 0;
+        return (int)bytes;
+    }
+    bool write(const std::string& data) override {
+        OVERLAPPED ov = {};
+        ov.hEvent = io_event;
+        ResetEvent(io_event);
+        DWORD bytes = 0;
+        if (!WriteFile(pipe, data.data(), (DWORD)data.size(), nullptr, &ov) && GetLastError() != ERROR_IO_PENDING) return false;
+        return finish(ov, bytes) && bytes == data.size();
+    }
+    void disconnect() override { DisconnectNamedPipe(pipe); }
+    void stop() override { SetEvent(stopped); }
+private:
+    // Waits for an overlapped operation; false if it failed or stop() was called
+    bool finish(OVERLAPPED& ov, DWORD& bytes) {
+        HANDLE handles[2] = {io_event, stopped};
+        if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) != WAIT_OBJECT_0) {
+            CancelIoEx(pipe, &ov);
+            GetOverlappedResult(pipe, &ov, &bytes, TRUE);
+            return false;
+        }
+        return GetOverlappedResult(pipe, &ov, &bytes, FALSE) != 0;
+    }
+
+    HANDLE pipe = INVALID_HANDLE_VALUE;
+    HANDLE io_event;
+    HANDLE stopped;
 };
 
-const Config default_config{};
+// Overlapped ReadDirectoryChangesW on the working directory; stop() signals
+// a second event so the wait can be abandoned
+class Win32FileWatcher : public FileWatcher {
+public:
+    Win32FileWatcher() {
+        dir = CreateFileA(".", FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                          OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+        changed = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+        stopped = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+    }
+    ~Win32FileWatcher() {
+        if (dir != INVALID_HANDLE_VALUE) CloseHandle(dir);
+        if (changed) CloseHandle(changed);
+        if (stopped) CloseHandle(stopped);
+    }
+    bool ok() const { return dir != INVALID_HANDLE_VALUE && changed && stopped; }
+    bool wait(std::vector<std::string>& names) override {
+        names.clear();
+        if (!ok()) return false;
+        OVERLAPPED ov = {};
+        ov.hEvent = changed;
+        ResetEvent(changed);
+        if (!ReadDirectoryChangesW(dir, buffer, sizeof(buffer), FALSE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE,
+                                   nullptr, &ov, nullptr)) {
+            return false;
+        }
+        HANDLE handles[2] = {changed, stopped};
+        DWORD bytes = 0;
+        if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) != WAIT_OBJECT_0) {
+            CancelIoEx(dir, &ov);
+            GetOverlappedResult(dir, &ov, &bytes, TRUE); // the buffer must outlive the request
+            return false;
+        }
+        if (!GetOverlappedResult(dir, &ov, &bytes, FALSE)) return false;
+        if (bytes == 0) { // more changes than fit in the buffer
+            names.push_back("");
+            return true;
+        }
+        const char* p = (const char*)buffer;
+        while (true) {
+            const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)p;
+            int wchars = (int)(info->FileNameLength / sizeof(WCHAR));
+            char name[MAX_PATH * 3];
+            int len = WideCharToMultiByte(CP_UTF8, 0, info->FileName, wchars, name, sizeof(name), nullptr, nullptr);
+            names.push_back(std::string(name, len > 0 ? len : 0));
+            if (info->NextEntryOffset == 0) break;
+            p += info->NextEntryOffset;
+        }
+        return true;
+    }
+    void stop() override { SetEvent(stopped); }
+private:
+    HANDLE dir;
+    HANDLE changed;
+    HANDLE stopped;
+    DWORD buffer[4096]; // ReadDirectoryChangesW needs DWORD alignment
+};
+#else
+// ANSI terminal console
+class TerminalConsole : public Console {
+public:
+    ~TerminalConsole() { set_raw(false); }
+    void write_colored(const std::string& text, WORD color) override {
+        int ansi = ((color & FOREGROUND_RED) ? 1 : 0) | ((color & FOREGROUND_GREEN) ? 2 : 0) | ((color & FOREGROUND_BLUE) ? 4 : 0);
+        std::cout << "\x1b[" << ((color & FOREGROUND_INTENSITY) ? 90 : 30) + ansi << 'm' << text << "\x1b[0m" << std::flush;
+    }
+    void clear() override { std::cout << "\x1b[2J\x1b[H" << std::flush; }
+    void set_title(const std::string& title) override { std::cout << "\x1b]0;" << title << '\a' << std::flush; }
+    bool kbhit() override {
+        struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+        return poll(&pfd, 1, 0) > 0;
+    }
+    int getch() override {
+        bool was_raw = raw;
+        set_raw(true);
+        unsigned char c = 0;
+        ssize_t n = read(STDIN_FILENO, &c, 1);
+        set_raw(was_raw);
+        if (n != 1) return -1;
+        // Match the Windows console().getch() codes
+        if (c == '\n') return KEY_CODE_ENTER;
+        if (c == 127) return KEY_CODE_BACKSPACE;
+        return c;
+    }
+    void set_raw(bool on) override {
+        if (on == raw || !isatty(STDIN_FILENO)) return;
+        if (on) {
+            tcgetattr(STDIN_FILENO, &saved);
+            struct termios t = saved;
+            t.c_lflag &= ~(ICANON | ECHO);
+            t.c_cc[VMIN] = 1;
+            t.c_cc[VTIME] = 0;
+            tcsetattr(STDIN_FILENO, TCSANOW, &t);
+        } else {
+            tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+        }
+        raw = on;
+    }
+private:
+    bool raw = false;
+    struct termios saved;
+};
 
-void save_config(const Config& cfg, const std::string& filename) {
-    std::ofstream ofs(filename);
-    if (ofs) {
-        ofs << "# Mascon Lever Input Translator Config\n";
-        ofs << "debounce_ms=" << cfg.debounce_ms << "\n";
-        ofs << "up_down_delay_ms=" << cfg.up_down_delay_ms << "\n";
-        ofs << "mouse_scroll_delay_ms=" << cfg.mouse_scroll_delay_ms << "\n";
-        ofs << "key_hold_time_ms=" << cfg.key_hold_time_ms << "\n"; // New
-        ofs << "last_mode=" << cfg.last_mode << "\n";
-        ofs << "last_joystick=" << cfg.last_joystick << "\n";
-        ofs << "language=" << cfg.language << "\n"; // New: save language
-        ofs << "big_horn_button=" << cfg.big_horn_button << "\n";
-        ofs << "small_horn_button=" << cfg.small_horn_button << "\n";
-        ofs << "credit_button=" << cfg.credit_button << "\n";
-        ofs << "test_menu_button=" << cfg.test_menu_button << "\n";
-        ofs << "debug_mission_button=" << cfg.debug_mission_button << "\n";
-        ofs << "profile=" << cfg.profile << "\n"; // New: save profile
-        ofs << "# Lever mappings: 15 lines, each line is a space-separated list of button indices for a position\n";
-        for (const auto& s : cfg.lever_mappings) {
-            for (int b : s) ofs << b << ' ';
-            ofs << '\n';
-        }
-        ofs << "# Lever keycodes: 15 lines, each line is a virtual-key code for a position (mode 2)\n";
-        for (int k : cfg.lever_keycodes) ofs << k << '\n';
+// Virtual keyboard/mouse created through /dev/uinput
+class UinputOutputSink : public OutputSink {
+public:
+    UinputOutputSink() {
+        fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+        if (fd < 0) return;
+        ioctl(fd, UI_SET_EVBIT, EV_KEY);
+        for (int vk = 0; vk < 256; ++vk) {
+            int code = linux_key(vk);
+            if (code > 0) ioctl(fd, UI_SET_KEYBIT, code);
+        }
+        ioctl(fd, UI_SET_EVBIT, EV_REL);
+        ioctl(fd, UI_SET_RELBIT, REL_WHEEL);
+        struct uinput_setup setup;
+        memset(&setup, 0, sizeof(setup));
+        setup.id.bustype = BUS_USB;
+        setup.id.vendor = 0x1209;  // pid.codes test VID
+        setup.id.product = 0x0001;
+        strncpy(setup.name, "Mascon Lever Input Translator", UINPUT_MAX_NAME_SIZE - 1);
+        if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    ~UinputOutputSink() {
+        if (fd >= 0) {
+            ioctl(fd, UI_DEV_DESTROY);
+            close(fd);
+        }
+    }
+    bool ok() const { return fd >= 0; }
+    void key_event(int vk, bool key_up, bool scancode) override {
+        std::vector<struct input_event> evs;
+        add_event(evs, SinkEvent{key_up ? OutputKind::KeyUp : OutputKind::KeyDown, vk, scancode});
+        write_events(evs);
+    }
+    void scroll(int amount) override {
+        std::vector<struct input_event> evs;
+        add_event(evs, SinkEvent{OutputKind::Scroll, amount, false});
+        write_events(evs);
+    }
+    // Each event still gets its own SYN_REPORT (a press and release in the
+    // same report would be merged), but all go out in one write()
+    void send_batch(const std::vector<SinkEvent>& events) override {
+        std::vector<struct input_event> evs;
+        for (const auto& ev : events) add_event(evs, ev);
+        write_events(evs);
     }
-}
 
-bool load_config(Config& cfg, const std::string& filename) {
-    std::ifstream ifs(filename);
-    if (!ifs) return false;
-    std::string line;
-    int loaded = 0;
-    int lever_keycode_count = 0;
-    cfg.lever_mappings.clear(); // Ensure clean state
-    cfg.lever_keycodes = std::vector<int>(15, 0); // Reset keycodes
-    while (std::getline(ifs, line)) {
-        if (line.empty() || line[0] == '#') continue;
-        auto get_value = [](const std::string& line, size_t prefix_len) -> std::string {
-            std::string val = line.substr(prefix_len);
-            // Trim whitespace
-            val.erase(0, val.find_first_not_of(" \t"));
-            val.erase(val.find_last_not_of(" \t") + 1);
-            return val;
-        };
-        if (line.find("debounce_ms=") == 0) {
-            try {
-                std::string val = get_value(line, 12);
-                cfg.debounce_ms = val.empty() ? default_config.debounce_ms : std::stoi(val);
-            } catch (const std::exception&) { cfg.debounce_ms = default_config.debounce_ms; }
-            ++loaded; continue;
+    // Windows virtual-key code -> Linux input key code (0 = unsupported)
+    static int linux_key(int vk) {
+        if (vk >= 'A' && vk <= 'Z') {
+            static const int letters[26] = {
+                KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F, KEY_G, KEY_H, KEY_I, KEY_J, KEY_K, KEY_L, KEY_M,
+                KEY_N, KEY_O, KEY_P, KEY_Q, KEY_R, KEY_S, KEY_T, KEY_U, KEY_V, KEY_W, KEY_X, KEY_Y, KEY_Z
+            };
+            return letters[vk - 'A'];
         }
-        if (line.find("up_down_delay_ms=") == 0) {
-            try {
-                std::string val = get_value(line, 17);
-                cfg.up_down_delay_ms = val.empty() ? default_config.up_down_delay_ms : std::stoi(val);
-            } catch (const std::exception&) { cfg.up_down_delay_ms = default_config.up_down_delay_ms; }
-            ++loaded; continue;
+        if (vk >= '1' && vk <= '9') return KEY_1 + (vk - '1');
+        if (vk == '0') return KEY_0;
+        if (vk >= 0x70 && vk <= 0x7B) { // F1-F12
+            static const int fkeys[12] = { KEY_F1, KEY_F2, KEY_F3, KEY_F4, KEY_F5, KEY_F6, KEY_F7, KEY_F8, KEY_F9, KEY_F10, KEY_F11, KEY_F12 };
+            return fkeys[vk - 0x70];
         }
-        if (line.find("mouse_scroll_delay_ms=") == 0) {
-            try {
-                std::string val = get_value(line, 22);
-                cfg.mouse_scroll_delay_ms = val.empty() ? default_config.mouse_scroll_delay_ms : std::stoi(val);
-            } catch (const std::exception&) { cfg.mouse_scroll_delay_ms = default_config.mouse_scroll_delay_ms; }
-            ++loaded; continue;
+        switch (vk) {
+        case 0x08: return KEY_BACKSPACE;
+        case VK_TAB: return KEY_TAB;
+        case VK_RETURN: return KEY_ENTER;
+        case VK_ESCAPE: return KEY_ESC;
+        case VK_SPACE: return KEY_SPACE;
+        case 0x21: return KEY_PAGEUP;
+        case 0x22: return KEY_PAGEDOWN;
+        case 0x23: return KEY_END;
+        case 0x24: return KEY_HOME;
+        case VK_LEFT: return KEY_LEFT;
+        case VK_UP: return KEY_UP;
+        case VK_RIGHT: return KEY_RIGHT;
+        case VK_DOWN: return KEY_DOWN;
+        case 0x2D: return KEY_INSERT;
+        case 0x2E: return KEY_DELETE;
+        case VK_LSHIFT: return KEY_LEFTSHIFT;
+        case VK_RSHIFT: return KEY_RIGHTSHIFT;
+        case 0xA2: return KEY_LEFTCTRL;
+        case 0xA3: return KEY_RIGHTCTRL;
+        case 0xBA: return KEY_SEMICOLON;
+        case 0xBB: return KEY_EQUAL;
+        case 0xBC: return KEY_COMMA;
+        case 0xBD: return KEY_MINUS;
+        case 0xBE: return KEY_DOT;
+        case 0xBF: return KEY_SLASH;
+        case 0xC0: return KEY_GRAVE;
+        case VK_OEM_4: return KEY_LEFTBRACE;
+        case 0xDC: return KEY_BACKSLASH;
+        case 0xDD: return KEY_RIGHTBRACE;
+        case 0xDE: return KEY_APOSTROPHE;
+        default: return 0;
         }
-        if (line.find("key_hold_time_ms=") == 0) {
-            try {
-                std::string val = get_value(line, 16);
-                cfg.key_hold_time_ms = val.empty() ? default_config.key_hold_time_ms : std::stoi(val);
-            } catch (const std::exception&) { cfg.key_hold_time_ms = default_config.key_hold_time_ms; }
-            ++loaded; continue;
+    }
+
+private:
+    static void push(std::vector<struct input_event>& evs, int type, int code, int value) {
+        struct input_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.type = (unsigned short)type;
+        ev.code = (unsigned short)code;
+        ev.value = value;
+        evs.push_back(ev);
+    }
+
+    static void add_event(std::vector<struct input_event>& evs, const SinkEvent& ev) {
+        if (ev.kind == OutputKind::Scroll) {
+            // Windows uses +120 per notch away from the user, as does REL_WHEEL +1
+            push(evs, EV_REL, REL_WHEEL, ev.code / 120);
+        } else {
+            int code = linux_key(ev.code);
+            if (code <= 0) return;
+            push(evs, EV_KEY, code, ev.kind == OutputKind::KeyUp ? 0 : 1);
         }
-        if (line.find("last_mode=") == 0) {
-            try {
-                std::string val = get_value(line, 10);
-                cfg.last_mode = val.empty() ? default_config.last_mode : std::stoi(val);
-            } catch (const std::exception&) { cfg.last_mode = default_config.last_mode; }
-            ++loaded; continue;
+        push(evs, EV_SYN, SYN_REPORT, 0);
+    }
+
+    void write_events(const std::vector<struct input_event>& evs) {
+        if (fd < 0 || evs.empty()) return;
+        ssize_t written = write(fd, evs.data(), evs.size() * sizeof(struct input_event));
+        (void)written;
+    }
+
+    int fd = -1;
+};
+
+// The terminal only delivers keys while it has focus, so no focus check is
+// needed; the terminal is kept in raw mode while translation is running
+class TerminalHotkeys : public Hotkeys {
+public:
+    explicit TerminalHotkeys(Console& c) : con(c) {}
+    HotkeyAction poll() override {
+        while (con.kbhit()) {
+            int ch = con.getch();
+            if (ch == KEY_CODE_TAB) return HOTKEY_SETTINGS;
+            if (ch == KEY_CODE_ESC) {
+                if (!con.kbhit()) return HOTKEY_EXIT;
+                while (con.kbhit()) con.getch(); // arrow/function key sequence, not a bare Esc
+            }
         }
-        if (line.find("last_joystick=") == 0) {
-            try {
-                std::string val = get_value(line, 14);
-                cfg.last_joystick = val.empty() ? default_config.last_joystick : std::stoi(val);
-            } catch (const std::exception&) { cfg.last_joystick = default_config.last_joystick; }
-            ++loaded; continue;
+        return HOTKEY_NONE;
+    }
+private:
+    Console& con;
+};
+
+// Unix-domain stream socket; stop() writes to a pipe polled alongside it
+class UnixSocketControlServer : public ControlServer {
+public:
+    UnixSocketControlServer() {
+        if (pipe(stop_pipe) != 0) stop_pipe[0] = stop_pipe[1] = -1;
+    }
+    ~UnixSocketControlServer() {
+        disconnect();
+        if (listen_fd >= 0) {
+            close(listen_fd);
+            unlink(path.c_str());
         }
-        if (line.find("language=") == 0) {
-            std::string val = get_value(line, 9);
-            cfg.language = val.empty() ? default_config.language : val;
-            ++loaded; continue;
+        if (stop_pipe[0] >= 0) close(stop_pipe[0]);
+        if (stop_pipe[1] >= 0) close(stop_pipe[1]);
+    }
+    bool listen(const std::string& endpoint) override {
+        sockaddr_un addr = {};
+        if (stop_pipe[0] < 0 || endpoint.size() >= sizeof(addr.sun_path)) return false;
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, endpoint.c_str(), endpoint.size() + 1);
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0) return false;
+        unlink(endpoint.c_str()); // left behind by a previous run
+        if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(listen_fd, 1) != 0) {
+            close(listen_fd);
+            listen_fd = -1;
+            return false;
         }
-        if (line.find("big_horn_button=") == 0) {
-            try {
-                std::string val = get_value(line, 16);
-                cfg.big_horn_button = val.empty() ? default_config.big_horn_button : std::stoi(val);
-            } catch (const std::exception&) { cfg.big_horn_button = default_config.big_horn_button; }
-            ++loaded; continue;
+        path = endpoint;
+        return true;
+    }
+    bool accept() override {
+        while (wait_readable(listen_fd)) {
+            client_fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client_fd >= 0) return true;
+            if (errno != EINTR && errno != ECONNABORTED) return false;
         }
-        if (line.find("small_horn_button=") == 0) {
-            try {
-                std::string val = get_value(line, 18);
-                cfg.small_horn_button = val.empty() ? default_config.small_horn_button : std::stoi(val);
-            } catch (const std::exception&) { cfg.small_horn_button = default_config.small_horn_button; }
-            ++loaded; continue;
+        return false;
+    }
+    int read(char* buf, int size) override {
+        if (client_fd < 0) return 0;
+        if (!wait_readable(client_fd)) return -1;
+        ssize_t n = ::read(client_fd, buf, size);
+        return n > 0 ? (int)n : 0;
+    }
+    bool write(const std::string& data) override {
+        size_t done = 0;
+        while (client_fd >= 0 && done < data.size()) {
+            ssize_t n = send(client_fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            done += (size_t)n;
         }
-        if (line.find("credit_button=") == 0) {
-            try {
-                std::string val = get_value(line, 14);
-                cfg.credit_button = val.empty() ? default_config.credit_button : std::stoi(val);
-            } catch (const std::exception&) { cfg.credit_button = default_config.credit_button; }
-            ++loaded; continue;
+        return done == data.size();
+    }
+    void disconnect() override {
+        if (client_fd >= 0) close(client_fd);
+        client_fd = -1;
+    }
+    void stop() override {
+        if (stop_pipe[1] < 0) return;
+        ssize_t written = ::write(stop_pipe[1], "x", 1);
+        (void)written; // a full pipe already has a wakeup pending
+    }
+private:
+    // false once stopped
+    bool wait_readable(int fd) {
+        if (fd < 0) return false;
+        while (true) {
+            pollfd fds[2] = {{fd, POLLIN, 0}, {stop_pipe[0], POLLIN, 0}};
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (fds[1].revents) return false;
+            return true;
         }
-        if (line.find("test_menu_button=") == 0) {
-            try {
-                std::string val = get_value(line, 17);
-                cfg.test_menu_button = val.empty() ? default_config.test_menu_button : std::stoi(val);
-            } catch (const std::exception&) { cfg.test_menu_button = default_config.test_menu_button; }
-            ++loaded; continue;
+    }
+
+    int listen_fd = -1;
+    int client_fd = -1;
+    int stop_pipe[2];
+    std::string path;
+};
+
+// There is no portable way to ask X11 or Wayland compositors for the
+// focused window, so a small hook (e.g. an xdotool loop or a compositor
+// script) writes it to a file as "class=", "title=" and "exe=" lines:
+// $MASCON_FOREGROUND_FILE, or $XDG_RUNTIME_DIR/mascon_foreground.
+class FileForegroundWindow : public ForegroundWindow {
+public:
+    FileForegroundWindow() {
+        if (const char* path = getenv("MASCON_FOREGROUND_FILE")) filename = path;
+        else if (const char* dir = getenv("XDG_RUNTIME_DIR")) filename = std::string(dir) + "/mascon_foreground";
+    }
+    bool identity(WindowIdentity& window) override {
+        if (filename.empty()) return false;
+        std::ifstream ifs(filename);
+        if (!ifs) return false;
+        window = WindowIdentity();
+        std::string line;
+        while (std::getline(ifs, line)) {
+            if (line.find("class=") == 0) window.window_class = line.substr(6);
+            else if (line.find("title=") == 0) window.title = line.substr(6);
+            else if (line.find("exe=") == 0) window.exe = line.substr(4);
         }
-        if (line.find("debug_mission_button=") == 0) {
-            try {
-                std::string val = get_value(line, 21);
-                cfg.debug_mission_button = val.empty() ? default_config.debug_mission_button : std::stoi(val);
-            } catch (const std::exception&) { cfg.debug_mission_button = default_config.debug_mission_button; }
-            ++loaded; continue;
-        }
-        if (line.find("profile=") == 0) {
-            std::string val = get_value(line, 8);
-            cfg.profile = val.empty() ? default_config.profile : val;
-            ++loaded; continue;
-        }
-        // Lever mappings: after 11 values, next 15 lines are mappings
-        if (loaded >= 11 && cfg.lever_mappings.size() < 15) {
-            std::istringstream iss(line);
-            std::set<int> s;
-            int b;
-            while (iss >> b) s.insert(b);
-            cfg.lever_mappings.push_back(s);
-            continue;
+        return true;
+    }
+private:
+    std::string filename;
+};
+
+// inotify on the working directory. Editors either rewrite the file
+// (IN_CLOSE_WRITE) or write a temporary and rename it over (IN_MOVED_TO);
+// deletes and renames away are reported too.
+// stop() writes to a pipe that wait() polls alongside the inotify fd.
+class InotifyFileWatcher : public FileWatcher {
+public:
+    InotifyFileWatcher() {
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd >= 0 && inotify_add_watch(fd, ".", IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) < 0) {
+            close(fd);
+            fd = -1;
         }
-        // Lever keycodes: after lever mappings, next 15 lines are keycodes
-        if (loaded >= 26 && lever_keycode_count < 15) {
-            try {
-                std::string val = get_value(line, 0);
-                cfg.lever_keycodes[lever_keycode_count++] = val.empty() ? 0 : std::stoi(val);
-            } catch (const std::exception&) {
-                cfg.lever_keycodes[lever_keycode_count++] = 0;
+        if (pipe(stop_pipe) != 0) stop_pipe[0] = stop_pipe[1] = -1;
+    }
+    ~InotifyFileWatcher() {
+        if (fd >= 0) close(fd);
+        if (stop_pipe[0] >= 0) close(stop_pipe[0]);
+        if (stop_pipe[1] >= 0) close(stop_pipe[1]);
+    }
+    bool ok() const { return fd >= 0 && stop_pipe[0] >= 0; }
+    bool wait(std::vector<std::string>& names) override {
+        names.clear();
+        if (!ok()) return false;
+        while (names.empty()) {
+            pollfd fds[2] = {{fd, POLLIN, 0}, {stop_pipe[0], POLLIN, 0}};
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (fds[1].revents) return false;
+            // Drain everything queued so one burst of writes is one wakeup
+            alignas(inotify_event) char buf[4096];
+            ssize_t n;
+            while ((n = read(fd, buf, sizeof(buf))) > 0) {
+                for (char* p = buf; p < buf + n;) {
+                    const inotify_event* ev = (const inotify_event*)p;
+                    if (ev->mask & IN_Q_OVERFLOW) names.push_back("");
+                    else if (ev->len > 0) names.push_back(ev->name);
+                    p += sizeof(inotify_event) + ev->len;
+                }
             }
-            continue;
         }
+        return true;
     }
-    // If not enough keycodes, fill with 0
-    while (lever_keycode_count < 15) cfg.lever_keycodes[lever_keycode_count++] = 0;
-    // If not enough mappings, fill with defaults
-    while (cfg.lever_mappings.size() < 15) {
-        cfg.lever_mappings.push_back(default_config.lever_mappings[cfg.lever_mappings.size()]);
+    void stop() override {
+        if (stop_pipe[1] < 0) return;
+        ssize_t written = write(stop_pipe[1], "x", 1);
+        (void)written; // a full pipe already has a wakeup pending
     }
-    return loaded >= 5; // still require at least 5 for legacy support
+private:
+    int fd;
+    int stop_pipe[2];
+};
+#endif
+
+Console& console() {
+#ifdef _WIN32
+    static Win32Console instance;
+#else
+    static TerminalConsole instance;
+#endif
+    return instance;
 }
 
-// Helper to print colored text in Windows console
-void print_colored(const std::string& text, WORD color) {
-    HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-    CONSOLE_SCREEN_BUFFER_INFO info;
-    GetConsoleScreenBufferInfo(hConsole, &info);
-    WORD original = info.wAttributes;
-    // Do not remap any colors; always use the color provided
-    SetConsoleTextAttribute(hConsole, color);
-    std::cout << text;
-    SetConsoleTextAttribute(hConsole, original);
+Hotkeys& hotkeys() {
+#ifdef _WIN32
+    static Win32Hotkeys instance;
+#else
+    static TerminalHotkeys instance(console());
+#endif
+    return instance;
 }
 
-// Loads translations from lang/lang_xx.json
-void load_translations(const std::string& lang_code) {
-    std::string path = "lang/lang_" + lang_code + ".json";
-    std::ifstream ifs(path);
-    if (ifs) {
-        ifs >> translations;
-    } else {
-        translations = nlohmann::json();
-    }
+ForegroundWindow& foreground_window() {
+#ifdef _WIN32
+    static Win32ForegroundWindow instance;
+#else
+    static FileForegroundWindow instance;
+#endif
+    return instance;
 }
 
-// Translation function using loaded JSON
-// No debug output
+#ifdef _WIN32
+typedef Win32OutputSink PlatformOutputSink;
+typedef Win32FileWatcher PlatformFileWatcher;
+typedef Win32PipeControlServer PlatformControlServer;
+#else
+typedef UinputOutputSink PlatformOutputSink;
+typedef InotifyFileWatcher PlatformFileWatcher;
+typedef UnixSocketControlServer PlatformControlServer;
+#endif
 
-template<typename... Args>
-std::string tr(const std::string& text, Args&&... args) {
-    if (translations.contains(text)) {
-        if (translations[text].is_string()) {
-            return translations[text].get<std::string>();
-        }
+void clear_screen() {
+    console().clear();
+}
+
+// Virtual-key code for a typed character, or -1 if it has none
+int vk_from_char(char ch) {
+#ifdef _WIN32
+    SHORT vk = VkKeyScanA(ch);
+    return vk == -1 ? -1 : (vk & 0xFF);
+#else
+    if (ch >= 'a' && ch <= 'z') return ch - 'a' + 'A';
+    if ((ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9')) return ch;
+    switch (ch) {
+    case ' ': return VK_SPACE;
+    case ';': return 0xBA;
+    case '=': return 0xBB;
+    case ',': return 0xBC;
+    case '-': return 0xBD;
+    case '.': return 0xBE;
+    case '/': return 0xBF;
+    case '`': return 0xC0;
+    case '[': return VK_OEM_4;
+    case '\\': return 0xDC;
+    case ']': return 0xDD;
+    case '\'': return 0xDE;
+    default: return -1;
     }
-    return text;
+#endif
 }
 
-// Enhanced language select function with AI translation notice
-std::string select_language(const std::string& current) {
-    while (true) {
-        std::cout << "\n--- Language Selection ---\n";
-        std::cout << "NOTICE: All translations were done by AI and have not been checked for accuracy.\n";
-        std::cout << "Current: ";
-        if (current == "en") std::cout << "English";
-        else if (current == "es") std::cout << "Spanish";
-        else if (current == "de") std::cout << "German";
-        else if (current == "ko") std::cout << "Korean";
-        else if (current == "zh") std::cout << "Chinese";
-        else if (current == "ja") std::cout << "Japanese";
-        else if (current == "fr") std::cout << "French";
-        else if (current == "it") std::cout << "Italian";
-        else if (current == "pt") std::cout << "Portuguese";
-        else if (current == "ru") std::cout << "Russian";
-        else if (current == "tr") std::cout << "Turkish";
-        else if (current == "ar") std::cout << "Arabic";
-        else if (current == "hi") std::cout << "Hindi";
-        else if (current == "vi") std::cout << "Vietnamese";
-        else if (current == "id") std::cout << "Indonesian";
-        else if (current == "ms") std::cout << "Malay";
-        else std::cout << current;
-        std::cout << "\nAvailable languages:\n";
-        std::cout << " 1. English (en) (English)\n";
-        std::cout << " 2. Spanish (es) (Español)\n";
-        std::cout << " 3. German (de) (Deutsch)\n";
-        std::cout << " 4. Korean (ko) (한국어)\n";
-        std::cout << " 5. Chinese (zh) (中文)\n";
-        std::cout << " 6. Japanese (ja) (日本語)\n";
-        std::cout << " 7. French (fr) (Français)\n";
-        std::cout << " 8. Italian (it) (Italiano)\n";
-        std::cout << " 9. Portuguese (pt) (Português)\n";
-        std::cout << "10. Russian (ru) (Русский)\n";
-        std::cout << "11. Turkish (tr) (Türkçe)\n";
-        std::cout << "12. Arabic (ar) (العربية)\n";
-        std::cout << "13. Hindi (hi) (हिन्दी)\n";
-        std::cout << "14. Vietnamese (vi) (Tiếng Việt)\n";
-        std::cout << "15. Indonesian (id) (Bahasa Indonesia)\n";
-        std::cout << "16. Malay (ms) (Bahasa Melayu)\n";
-        std::cout << "Select language (1-16): ";
-        std::string input;
-        std::getline(std::cin, input);
-        if (input == "1") return "en";
-        if (input == "2") return "es";
-        if (input == "3") return "de";
-        if (input == "4") return "ko";
-        if (input == "5") return "zh";
-        if (input == "6") return "ja";
-        if (input == "7") return "fr";
-        if (input == "8") return "it";
-        if (input == "9") return "pt";
-        if (input == "10") return "ru";
-        if (input == "11") return "tr";
-        if (input == "12") return "ar";
-        if (input == "13") return "hi";
-        if (input == "14") return "vi";
-        if (input == "15") return "id";
-        if (input == "16") return "ms";
-        std::cout << "Invalid selection. Please choose 1-16.\n";
+// Names of the files in the working directory with the given extension
+std::vector<std::string> list_files_with_extension(const std::string& ext, const std::string& dir = ".") {
+    std::vector<std::string> files;
+#ifdef _WIN32
+    WIN32_FIND_DATAA findFileData;
+    HANDLE hFind = FindFirstFileA((dir + "\\*" + ext).c_str(), &findFileData);
+    if (hFind != INVALID_HANDLE_VALUE) {
+        do {
+            files.push_back(findFileData.cFileName);
+        } while (FindNextFileA(hFind, &findFileData));
+        FindClose(hFind);
+    }
+#else
+    DIR* d = opendir(dir.c_str());
+    if (d) {
+        while (struct dirent* entry = readdir(d)) {
+            std::string fname = entry->d_name;
+            if (fname.size() > ext.size() && fname.compare(fname.size() - ext.size(), ext.size(), ext) == 0) {
+                files.push_back(fname);
+            }
+        }
+        closedir(d);
     }
+#endif
+    return files;
 }
 
-// Add language select to settings_menu
-void settings_menu(Config& cfg, const std::string& filename, int& mode, int& selected_id, int num_joysticks) {
-    auto get_profile_filename = [&cfg]() -> std::string {
-        return (cfg.profile == "Default") ? "mascon_translator.cfg" : (cfg.profile + ".cfg");
-    };
-    save_config(cfg, get_profile_filename());
-    while (true) {
-        std::cout << "\n--- " << tr("Settings", cfg.language) << " Menu (" << tr("Profile", cfg.language) << ": " << cfg.profile << ") (press ";
-        print_colored(tr("Enter", cfg.language), FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-        std::cout << " to keep current value) ---\n";
-        std::cout << tr("Current values:", cfg.language) << std::endl;
-        print_colored("0. " + tr("Profile", cfg.language) + ": " + cfg.profile + "\n", FOREGROUND_CYAN);
-        print_colored("1. " + tr("Joystick debounce ms: ", cfg.language), FOREGROUND_BLUE | FOREGROUND_INTENSITY);
-        std::cout << cfg.debounce_ms << "\n";
-        print_colored("2. " + tr("Up/Down Arrow delay ms: ", cfg.language), FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-        std::cout << cfg.up_down_delay_ms << "\n";
-        print_colored("3. " + tr("Mouse scroll delay ms: ", cfg.language), FOREGROUND_RED | FOREGROUND_BLUE | FOREGROUND_INTENSITY);
+typedef std::chrono::steady_clock Clock;
+
+// Log-linear latency histogram in microseconds (HDR-style): each power of two
+// is split into 16 linear sub-buckets, so every percentile is within ~6%.
+// Counters are atomic so the menu can read while the scheduler records.
+class LatencyHistogram {
+public:
+    LatencyHistogram() { reset(); }
+
+    void reset() {
+        for (int i = 0; i < NUM_BUCKETS; ++i) counts[i].store(0, std::memory_order_relaxed);
+        total.store(0, std::memory_order_relaxed);
+        max_us.store(0, std::memory_order_relaxed);
+    }
+
+    void record(int64_t us) {
+        if (us < 0) us = 0;
+        if (us > MAX_VALUE) us = MAX_VALUE;
+        counts[bucket_of(us)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        int64_t prev = max_us.load(std::memory_order_relaxed);
+        while (us > prev && !max_us.compare_exchange_weak(prev, us, std::memory_order_relaxed)) {}
+    }
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    int64_t max() const { return max_us.load(std::memory_order_relaxed); }
+
+    // Upper bound of the bucket holding the given percentile (0-100)
+    int64_t percentile(double p) const {
+        uint64_t n = count();
+        if (n == 0) return 0;
+        uint64_t rank = (uint64_t)(p / 100.0 * (double)n + 0.5);
+        if (rank < 1) rank = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < NUM_BUCKETS; ++i) {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen >= rank) return std::min(bucket_upper(i), max());
+        }
+        return max();
+    }
+
+private:
+    static const int SUB_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BITS;
+    static const int MAGNITUDES = 34; // up to 2^37 us (~38 hours)
+    static const int NUM_BUCKETS = MAGNITUDES * SUB_BUCKETS;
+    static const int64_t MAX_VALUE = ((int64_t)1 << 37) - 1;
+
+    static int bucket_of(int64_t v) {
+        if (v < SUB_BUCKETS) return (int)v;
+        int msb = 0;
+        while ((v >> (msb + 1)) != 0) ++msb;
+        int shift = msb - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + (int)((v >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    static int64_t bucket_upper(int bucket) {
+        if (bucket < SUB_BUCKETS) return bucket;
+        int shift = bucket / SUB_BUCKETS - 1;
+        int64_t sub = bucket % SUB_BUCKETS;
+        return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+    }
+
+    std::atomic<uint64_t> counts[NUM_BUCKETS];
+    std::atomic<uint64_t> total;
+    std::atomic<int64_t> max_us;
+};
+
+// Latency channels (one per output mode, plus horns/credit/test/debug)
+enum LatencyChannel { LAT_ARROW = 0, LAT_SCROLL, LAT_LEVER_KEY, LAT_SPECIAL, LAT_CHANNELS };
+// Pipeline stages measured for every output
+enum LatencyStage { LAT_READ_TO_DECODE = 0, LAT_DECODE_TO_ACCEPT, LAT_ACCEPT_TO_EMIT, LAT_TOTAL, LAT_STAGES };
+
+// When the button change behind an output was read from SDL, decoded and
+// accepted by the debounce; the scheduler adds the emission time
+struct LatencyStamps {
+    int channel = -1; // LatencyChannel, -1 = not measured
+    Clock::time_point read, decode, accept;
+};
+
+struct LatencyStats {
+    LatencyHistogram hist[LAT_CHANNELS][LAT_STAGES];
+
+    void record(const LatencyStamps& st, Clock::time_point emitted) {
+        if (st.channel < 0 || st.channel >= LAT_CHANNELS) return;
+        LatencyHistogram* h = hist[st.channel];
+        h[LAT_READ_TO_DECODE].record(micros(st.decode - st.read));
+        h[LAT_DECODE_TO_ACCEPT].record(micros(st.accept - st.decode));
+        h[LAT_ACCEPT_TO_EMIT].record(micros(emitted - st.accept));
+        h[LAT_TOTAL].record(micros(emitted - st.read));
+    }
+
+    void reset() {
+        for (int c = 0; c < LAT_CHANNELS; ++c)
+            for (int s = 0; s < LAT_STAGES; ++s) hist[c][s].reset();
+    }
+
+    static int64_t micros(Clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    }
+};
+
+LatencyStats latency_stats; // Global, filled in by the output scheduler
+
+// Format microseconds as milliseconds with 3 decimals
+std::string format_us(int64_t us) {
+    std::ostringstream oss;
+    oss << (us / 1000) << '.' << (char)('0' + (us / 100) % 10) << (char)('0' + (us / 10) % 10) << (char)('0' + us % 10);
+    return oss.str();
+}
+
+// Plain-text latency table (used by the settings menu and the file dump)
+std::string format_latency_report() {
+    static const char* channel_names[LAT_CHANNELS] = { "Arrow Keys", "Mouse Scroll", "Lever-to-Key", "Horn/Credit/Test/Debug" };
+    static const char* stage_names[LAT_STAGES] = { "read->decode", "decode->accept", "accept->emit", "total" };
+    std::ostringstream oss;
+    oss << "Latency (ms): count / p50 / p99 / p99.9 / max\n";
+    for (int c = 0; c < LAT_CHANNELS; ++c) {
+        if (latency_stats.hist[c][LAT_TOTAL].count() == 0) continue;
+        oss << channel_names[c] << "\n";
+        for (int st = 0; st < LAT_STAGES; ++st) {
+            const LatencyHistogram& h = latency_stats.hist[c][st];
+            oss << "  " << stage_names[st];
+            for (size_t pad = strlen(stage_names[st]); pad < 16; ++pad) oss << ' ';
+            oss << h.count() << " / " << format_us(h.percentile(50)) << " / " << format_us(h.percentile(99))
+                << " / " << format_us(h.percentile(99.9)) << " / " << format_us(h.max()) << "\n";
+        }
+    }
+    return oss.str();
+}
+
+// One queued output action
+struct OutputEvent {
+    Clock::time_point due;
+    uint64_t seq = 0;       // keeps FIFO order for events due at the same time
+    OutputKind kind = OutputKind::KeyDown;
+    int code = 0;           // virtual-key code, or wheel amount for Scroll
+    bool scancode = false;
+    std::vector<SinkEvent> batch; // if not empty, sent instead of kind/code as one batch
+    LatencyStamps stamps;
+};
+
+// Timed output scheduler: key down/up and scroll events are queued with a due
+// time on a deadline heap and sent from their own thread, so the input thread
+// never sleeps. Lever steps share one "lever channel" so that hold times and
+// the up/down and scroll delays become spacing between queued steps.
+class OutputScheduler {
+public:
+    explicit OutputScheduler(OutputSink& out) : sink(out) {}
+    ~OutputScheduler() { stop(); }
+
+    void start() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (running) return;
+        running = true;
+        worker = std::thread(&OutputScheduler::run, this);
+    }
+
+    // Sends everything still queued (so no key is left held down) and joins
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!running) return;
+            running = false;
+            cv.notify_all();
+        }
+        worker.join();
+    }
+
+    void schedule(Clock::time_point due, OutputKind kind, int code, bool scancode, const LatencyStamps& stamps = LatencyStamps()) {
+        OutputEvent ev;
+        ev.due = due;
+        ev.kind = kind;
+        ev.code = code;
+        ev.scancode = scancode;
+        ev.stamps = stamps;
+        push(ev);
+    }
+
+    // Sends 'events' together at 'due' (burst mode)
+    void schedule_batch(Clock::time_point due, const std::vector<SinkEvent>& events, const LatencyStamps& stamps = LatencyStamps()) {
+        OutputEvent ev;
+        ev.due = due;
+        ev.batch = events;
+        ev.stamps = stamps;
+        push(ev);
+    }
+
+    // Manual mode for trace replays: sends everything due up to 't' on the
+    // calling thread. Only valid while the worker thread is not started.
+    void run_until(Clock::time_point t) {
+        std::unique_lock<std::mutex> lock(mtx);
+        manual = true;
+        while (!queue.empty() && queue.top().due <= t) {
+            OutputEvent ev = queue.top();
+            queue.pop();
+            lock.unlock();
+            manual_time = ev.due; // each event goes out exactly when it was due
+            deliver(ev);
+            lock.lock();
+        }
+    }
+
+    // Time as seen by the sink: wall clock, or the due time of the event
+    // being delivered by run_until()
+    Clock::time_point now() const { return manual ? manual_time : Clock::now(); }
+
+    // Reserve the lever channel for 'busy' starting no earlier than 'now'.
+    // Returns when the step may start.
+    Clock::time_point reserve_lever(Clock::time_point now, std::chrono::milliseconds busy) {
+        std::lock_guard<std::mutex> lock(mtx);
+        Clock::time_point start = std::max(now, lever_free_at);
+        lever_free_at = start + busy;
+        return start;
+    }
+
+private:
+    struct Later {
+        bool operator()(const OutputEvent& a, const OutputEvent& b) const {
+            return a.due != b.due ? a.due > b.due : a.seq > b.seq;
+        }
+    };
+
+    void push(OutputEvent& ev) {
+        std::lock_guard<std::mutex> lock(mtx);
+        ev.seq = next_seq++;
+        bool earliest = queue.empty() || Later()(queue.top(), ev);
+        queue.push(ev);
+        if (earliest) cv.notify_all();
+    }
+
+    void deliver(const OutputEvent& ev) {
+        if (!ev.batch.empty()) sink.send_batch(ev.batch);
+        else if (ev.kind == OutputKind::Scroll) sink.scroll(ev.code);
+        else sink.key_event(ev.code, ev.kind == OutputKind::KeyUp, ev.scancode);
+    }
+
+    // Real-time path: also measure the latency (replays run on virtual time)
+    void emit(const OutputEvent& ev) {
+        deliver(ev);
+        latency_stats.record(ev.stamps, Clock::now());
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (running) {
+            if (queue.empty()) {
+                cv.wait(lock);
+                continue;
+            }
+            Clock::time_point due = queue.top().due;
+            if (Clock::now() < due) {
+                cv.wait_until(lock, due);
+                continue;
+            }
+            OutputEvent ev = queue.top();
+            queue.pop();
+            lock.unlock();
+            emit(ev);
+            lock.lock();
+        }
+        while (!queue.empty()) {
+            OutputEvent ev = queue.top();
+            queue.pop();
+            emit(ev);
+        }
+    }
+
+    OutputSink& sink;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::priority_queue<OutputEvent, std::vector<OutputEvent>, Later> queue;
+    uint64_t next_seq = 0;
+    Clock::time_point lever_free_at;
+    bool manual = false;
+    Clock::time_point manual_time;
+    bool running = false;
+    std::thread worker;
+};
+
+// One output as seen by a RecordingOutputSink
+struct RecordedOutput {
+    int64_t time_us; // since the sink was started
+    OutputKind kind;
+    int code;        // virtual-key code, or wheel amount for Scroll
+};
+
+// Sink that drops everything (benchmarks)
+class NullOutputSink : public OutputSink {
+public:
+    void key_event(int, bool, bool) override {}
+    void scroll(int) override {}
+};
+
+// Records every key down/up and wheel event with its time, optionally
+// passing it on to a real sink. 'clock' supplies the time (the scheduler's
+// virtual clock during replays). Written to only by the scheduler.
+class RecordingOutputSink : public OutputSink {
+public:
+    explicit RecordingOutputSink(OutputSink* inner_sink = nullptr) : inner(inner_sink) {}
+
+    void key_event(int vk, bool key_up, bool scancode) override {
+        if (inner) inner->key_event(vk, key_up, scancode);
+        add(key_up ? OutputKind::KeyUp : OutputKind::KeyDown, vk);
+    }
+    void scroll(int amount) override {
+        if (inner) inner->scroll(amount);
+        add(OutputKind::Scroll, amount);
+    }
+    // Keeps a burst in one call to the real sink
+    void send_batch(const std::vector<SinkEvent>& batch) override {
+        if (inner) inner->send_batch(batch);
+        for (const auto& ev : batch) add(ev.kind, ev.code);
+    }
+
+    // Event times are measured from 'origin' on 'time_source'
+    void start(std::function<Clock::time_point()> time_source, Clock::time_point origin) {
+        clock = time_source;
+        start_time = origin;
+        events.clear();
+    }
+
+    // One line per event, e.g. "130.000 down 0x28" or "45.000 scroll -120".
+    // This is also the golden-file format.
+    std::string format() const {
+        std::ostringstream oss;
+        for (const auto& ev : events) {
+            oss << format_us(ev.time_us) << " ";
+            if (ev.kind == OutputKind::Scroll) {
+                oss << "scroll " << ev.code << "\n";
+            } else {
+                char hex[8];
+                snprintf(hex, sizeof(hex), "0x%02X", ev.code);
+                oss << (ev.kind == OutputKind::KeyUp ? "up " : "down ") << hex << "\n";
+            }
+        }
+        return oss.str();
+    }
+
+    bool write(const std::string& filename) const {
+        std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+        file << format();
+        return (bool)file;
+    }
+
+    std::vector<RecordedOutput> events;
+
+private:
+    void add(OutputKind kind, int code) {
+        RecordedOutput ev;
+        ev.time_us = LatencyStats::micros(clock() - start_time);
+        ev.kind = kind;
+        ev.code = code;
+        events.push_back(ev);
+    }
+
+    OutputSink* inner;
+    std::function<Clock::time_point()> clock = Clock::now;
+    Clock::time_point start_time;
+};
+
+// Helper to match the largest subset first
+// (reference implementation; the main loop uses LeverDecoder below)
+int match_combo(const std::set<int>& pressed, const std::vector<std::set<int>>& combos) {
+    int best = -1;
+    int best_size = -1;
+    for (size_t i = 0; i < combos.size(); ++i) {
+        const auto& combo = combos[i];
+        if (std::includes(pressed.begin(), pressed.end(), combo.begin(), combo.end())) {
+            if ((int)combo.size() > best_size) {
+                best = (int)i;
+                best_size = (int)combo.size();
+            }
+        }
+    }
+    return best;
+}
+
+// Up to MAX_DEVICES joysticks (e.g. separate power and brake handles, a
+// horn pedal box) are merged into one logical controller: button b of
+// device d is logical button d * DEVICE_BUTTON_STRIDE + b, written "d:b" in
+// profiles. Device 0 is the mascon chosen in the settings menu, so its
+// buttons keep their plain numbers.
+const int MAX_DEVICES = 4;
+const int DEVICE_BUTTON_STRIDE = 64;
+const int DEVICE_AXIS_STRIDE = 8;
+
+// Fixed-width joystick button state, one bit per logical button index
+const int MAX_BUTTONS = MAX_DEVICES * DEVICE_BUTTON_STRIDE;
+struct ButtonMask {
+    uint64_t bits[MAX_BUTTONS / 64];
+    ButtonMask() { clear(); }
+    void clear() {
+        for (int w = 0; w < MAX_BUTTONS / 64; ++w) bits[w] = 0;
+    }
+    void set(int b) {
+        if (b >= 0 && b < MAX_BUTTONS) bits[b >> 6] |= (uint64_t)1 << (b & 63);
+    }
+    void reset(int b) {
+        if (b >= 0 && b < MAX_BUTTONS) bits[b >> 6] &= ~((uint64_t)1 << (b & 63));
+    }
+    bool test(int b) const {
+        return b >= 0 && b < MAX_BUTTONS && ((bits[b >> 6] >> (b & 63)) & 1) != 0;
+    }
+    // True if every button in 'other' is also set here
+    bool contains(const ButtonMask& other) const {
+        for (int w = 0; w < MAX_BUTTONS / 64; ++w) {
+            if ((bits[w] & other.bits[w]) != other.bits[w]) return false;
+        }
+        return true;
+    }
+    bool operator==(const ButtonMask& other) const {
+        for (int w = 0; w < MAX_BUTTONS / 64; ++w) {
+            if (bits[w] != other.bits[w]) return false;
+        }
+        return true;
+    }
+    bool operator!=(const ButtonMask& other) const { return !(*this == other); }
+};
+
+// One immutable reading of all devices, shared by every consumer in a tick
+// so the horn/credit handlers and the lever decoder always agree
+const int MAX_AXES = MAX_DEVICES * DEVICE_AXIS_STRIDE;
+typedef std::array<int16_t, MAX_AXES> AxisValues;
+
+struct InputSnapshot {
+    ButtonMask buttons;
+    AxisValues axes{}; // raw SDL axis values (analog levers)
+    uint32_t connected = ~0u; // bit per device, clear while it is unplugged (nothing is pressed then)
+    std::array<Clock::time_point, MAX_DEVICES> device_times{}; // when each device last reported a change
+    Clock::time_point timestamp;
+};
+
+// Helper to parse a button or axis reference, "index" (device 0) or
+// "device:index", into a logical index; removes it from the front of s
+bool parse_input_ref(std::string_view& s, int stride, int& value) {
+    int first;
+    auto result = std::from_chars(s.data(), s.data() + s.size(), first);
+    if (result.ec != std::errc()) return false;
+    s.remove_prefix(result.ptr - s.data());
+    if (s.empty() || s[0] != ':') {
+        value = first;
+        return true;
+    }
+    int index;
+    result = std::from_chars(s.data() + 1, s.data() + s.size(), index);
+    if (result.ec != std::errc() || first < 0 || first >= MAX_DEVICES || index < 0 || index >= stride) return false;
+    s.remove_prefix(result.ptr - s.data());
+    value = first * stride + index;
+    return true;
+}
+
+// Helper to format a logical button or axis index the way profiles write it
+std::string format_input_ref(int value, int stride) {
+    if (value < stride) return std::to_string(value);
+    return std::to_string(value / stride) + ":" + std::to_string(value % stride);
+}
+
+// Helper to read one device's buttons and axes into its part of the
+// logical state (call SDL_JoystickUpdate first)
+void read_device_state(SDL_Joystick* joy, int device, ButtonMask& buttons, AxisValues& axes) {
+    int num_buttons = std::min(SDL_JoystickNumButtons(joy), DEVICE_BUTTON_STRIDE);
+    for (int b = 0; b < num_buttons; ++b) {
+        if (SDL_JoystickGetButton(joy, b)) buttons.set(device * DEVICE_BUTTON_STRIDE + b);
+    }
+    int num_axes = std::min(SDL_JoystickNumAxes(joy), DEVICE_AXIS_STRIDE);
+    for (int a = 0; a < num_axes; ++a) axes[device * DEVICE_AXIS_STRIDE + a] = SDL_JoystickGetAxis(joy, a);
+}
+
+// Read all buttons and axes of one joystick (as device 0) with a single SDL_JoystickUpdate
+InputSnapshot read_snapshot(SDL_Joystick* joy) {
+    InputSnapshot snap;
+    SDL_JoystickUpdate();
+    snap.timestamp = Clock::now();
+    if (joy) read_device_state(joy, 0, snap.buttons, snap.axes);
+    return snap;
+}
+
+// Helper to get a device's GUID as text ("" if there is no such device)
+std::string joystick_guid(int device_index) {
+    if (device_index < 0 || device_index >= SDL_NumJoysticks()) return "";
+    char buf[33];
+    SDL_JoystickGetGUIDString(SDL_JoystickGetDeviceGUID(device_index), buf, sizeof(buf));
+    return buf;
+}
+
+// Device index to open: the first device with the saved GUID, so the
+// mascon is found again after being plugged into another port or
+// reordered, or -1 if it is not plugged in. The saved index is only used
+// when no GUID was saved yet; with a GUID, whatever now sits at that index
+// is some other device (often the pedal box). Devices in 'skip' (instance
+// IDs) are already in use, e.g. the other of two identical handles.
+int find_joystick(const std::string& guid, int fallback_index, const std::vector<SDL_JoystickID>& skip = {}) {
+    int count = SDL_NumJoysticks();
+    auto free = [&skip](int i) { return std::find(skip.begin(), skip.end(), SDL_JoystickGetDeviceInstanceID(i)) == skip.end(); };
+    if (!guid.empty()) {
+        for (int i = 0; i < count; ++i) {
+            if (joystick_guid(i) == guid && free(i)) return i;
+        }
+        return -1;
+    }
+    return (fallback_index >= 0 && fallback_index < count && free(fallback_index)) ? fallback_index : -1;
+}
+
+// The mascon is plugged in: the device with the saved GUID, or any device
+// while no GUID was saved yet
+bool mascon_present(const std::string& guid) {
+    return guid.empty() ? SDL_NumJoysticks() > 0 : find_joystick(guid, -1) >= 0;
+}
+
+// Helper to split a space-separated list (e.g. the extra_joysticks GUIDs)
+std::vector<std::string> split_words(const std::string& s) {
+    std::vector<std::string> words;
+    std::istringstream in(s);
+    std::string word;
+    while (in >> word) words.push_back(word);
+    return words;
+}
+
+// Where the input thread gets joystick state from
+class InputSource {
+public:
+    virtual ~InputSource() {}
+    // Read the full state again (after opening, or resuming from the settings menu)
+    virtual void reseed() = 0;
+    // Block for up to timeout_ms waiting for input
+    virtual void wait(int timeout_ms) = 0;
+    // Current state, frozen for one tick
+    virtual InputSnapshot snapshot() = 0;
+    // Make a blocked wait() return early (called from other threads)
+    virtual void wake() = 0;
+};
+
+// Joysticks read through SDL events (on Linux SDL itself reads evdev).
+// Device 0 and any extra devices are all served by this one source on the
+// input thread: their events arrive on the same SDL queue and update their
+// part of one logical button/axis state, so merging them costs nothing
+// per tick. Also handles hotplug: when a device is unplugged its handle is
+// closed and its part of the state reads as released and disconnected;
+// when a device with the same GUID is plugged back in it is reopened on the
+// input thread, without reinitialising SDL.
+class SdlInputSource : public InputSource {
+public:
+    ~SdlInputSource() { close(); }
+
+    // Opens device 0: the one with this GUID, or the one at 'index' if no
+    // GUID was saved yet. Returns the device index opened, or -1. With a GUID
+    // whose device is not plugged in, device 0 is left disconnected and
+    // opened when it appears; without one, the current device is kept.
+    // Call while the input thread is paused or not running.
+    int open(const std::string& guid, int index) {
+        int found = find_joystick(guid, index, open_ids(0));
+        SDL_Joystick* j = found >= 0 ? SDL_JoystickOpen(found) : nullptr;
+        if (!j && guid.empty()) return -1;
+        close_device(0);
+        devices[0].guid = j ? joystick_guid(found) : guid;
+        if (!j) return -1;
+        attach(0, j);
+        return found;
+    }
+
+    // Devices 1, 2, ... by GUID; ones not plugged in yet are opened when they
+    // appear. Call while the input thread is paused or not running.
+    void set_extra_devices(const std::vector<std::string>& guids) {
+        for (int d = 1; d < MAX_DEVICES; ++d) {
+            close_device(d);
+            devices[d].guid = d - 1 < (int)guids.size() ? guids[d - 1] : std::string();
+            if (devices[d].guid.empty()) continue;
+            int found = find_joystick(devices[d].guid, -1, open_ids(d));
+            if (SDL_Joystick* j = found >= 0 ? SDL_JoystickOpen(found) : nullptr) attach(d, j);
+        }
+    }
+
+    void close() {
+        for (int d = 0; d < MAX_DEVICES; ++d) close_device(d);
+    }
+
+    // GUID of device 0 (also while it is unplugged)
+    const std::string& guid() const { return devices[0].guid; }
+
+    // Events only report changes, so read the full button state once after
+    // opening the joysticks or resuming from the settings menu
+    void reseed() override {
+        SDL_Event ev;
+        while (SDL_PollEvent(&ev)) {
+            // Drop input queued while paused, but not plug/unplug events
+            if (ev.type == SDL_JOYDEVICEADDED || ev.type == SDL_JOYDEVICEREMOVED) handle_event(ev);
+        }
+        SDL_JoystickUpdate();
+        pressed.clear();
+        axes = AxisValues{};
+        for (int d = 0; d < MAX_DEVICES; ++d) {
+            if (devices[d].joy) read_device_state(devices[d].joy, d, pressed, axes);
+        }
+    }
+
+    void wait(int timeout_ms) override {
+        SDL_Event ev;
+        if (SDL_WaitEventTimeout(&ev, timeout_ms)) {
+            // Drain everything queued so multi-button lever transitions are seen together
+            do {
+                handle_event(ev);
+            } while (SDL_PollEvent(&ev));
+        }
+    }
+
+    // Freeze the event-maintained state for this tick
+    InputSnapshot snapshot() override {
+        InputSnapshot snap;
+        snap.buttons = pressed;
+        snap.axes = axes;
+        for (int d = 0; d < MAX_DEVICES; ++d) {
+            // Unused device slots count as connected
+            if (!devices[d].joy && (d == 0 || !devices[d].guid.empty())) snap.connected &= ~(1u << d);
+            snap.device_times[d] = devices[d].last_input;
+        }
+        snap.timestamp = Clock::now();
+        return snap;
+    }
+
+    void wake() override {
+        SDL_Event ev;
+        ev.type = SDL_USEREVENT;
+        SDL_PushEvent(&ev);
+    }
+
+private:
+    struct Device {
+        std::string guid;
+        SDL_Joystick* joy = nullptr;
+        SDL_JoystickID id = -1;
+        Clock::time_point last_input;
+    };
+
+    void handle_event(const SDL_Event& ev) {
+        if (ev.type == SDL_JOYBUTTONDOWN || ev.type == SDL_JOYBUTTONUP) {
+            int d = device_of(ev.jbutton.which);
+            if (d < 0 || ev.jbutton.button >= DEVICE_BUTTON_STRIDE) return;
+            int b = d * DEVICE_BUTTON_STRIDE + ev.jbutton.button;
+            if (ev.jbutton.state == SDL_PRESSED) pressed.set(b);
+            else pressed.reset(b);
+            devices[d].last_input = Clock::now();
+        } else if (ev.type == SDL_JOYAXISMOTION) {
+            int d = device_of(ev.jaxis.which);
+            if (d < 0 || ev.jaxis.axis >= DEVICE_AXIS_STRIDE) return;
+            axes[d * DEVICE_AXIS_STRIDE + ev.jaxis.axis] = ev.jaxis.value;
+            devices[d].last_input = Clock::now();
+        } else if (ev.type == SDL_JOYDEVICEREMOVED) {
+            int d = device_of(ev.jdevice.which);
+            if (d >= 0) close_device(d);
+        } else if (ev.type == SDL_JOYDEVICEADDED) {
+            // Also sent at startup for devices already open
+            if (device_of(SDL_JoystickGetDeviceInstanceID(ev.jdevice.which)) >= 0) return;
+            std::string added = joystick_guid(ev.jdevice.which);
+            int slot = -1;
+            for (int d = 0; d < MAX_DEVICES && slot < 0; ++d) {
+                if (!devices[d].joy && !devices[d].guid.empty() && devices[d].guid == added) slot = d;
+            }
+            // A mascon without a saved GUID takes the first device nobody else wants
+            if (slot < 0 && !devices[0].joy && devices[0].guid.empty()) slot = 0;
+            if (slot < 0) return;
+            if (SDL_Joystick* j = SDL_JoystickOpen(ev.jdevice.which)) {
+                devices[slot].guid = added;
+                attach(slot, j);
+                SDL_JoystickUpdate();
+                read_device_state(j, slot, pressed, axes);
+            }
+        }
+    }
+
+    int device_of(SDL_JoystickID id) const {
+        for (int d = 0; d < MAX_DEVICES; ++d) {
+            if (devices[d].joy && devices[d].id == id) return d;
+        }
+        return -1;
+    }
+
+    // Instance IDs of the open devices other than 'except'
+    std::vector<SDL_JoystickID> open_ids(int except) const {
+        std::vector<SDL_JoystickID> ids;
+        for (int d = 0; d < MAX_DEVICES; ++d) {
+            if (d != except && devices[d].joy) ids.push_back(devices[d].id);
+        }
+        return ids;
+    }
+
+    void attach(int d, SDL_Joystick* j) {
+        devices[d].joy = j;
+        devices[d].id = SDL_JoystickInstanceID(j);
+        devices[d].last_input = Clock::now();
+    }
+
+    // Closes the handle and releases everything the device had pressed
+    void close_device(int d) {
+        if (devices[d].joy) SDL_JoystickClose(devices[d].joy);
+        devices[d].joy = nullptr;
+        devices[d].id = -1;
+        for (int b = 0; b < DEVICE_BUTTON_STRIDE; ++b) pressed.reset(d * DEVICE_BUTTON_STRIDE + b);
+        for (int a = 0; a < DEVICE_AXIS_STRIDE; ++a) axes[d * DEVICE_AXIS_STRIDE + a] = 0;
+    }
+
+    std::array<Device, MAX_DEVICES> devices;
+    ButtonMask pressed; // kept up to date from SDL button events
+    AxisValues axes{};  // and axis events
+};
+
+// Input trace files: the button/axis state stream with monotonic
+// timestamps, for replaying lever handling offline (see --record and --replay).
+// Layout: "MLTR", a version byte, then one record per state change:
+//   varint  microseconds since the previous record
+//   varint  number of buttons that toggled
+//   byte    index of each toggled button
+//   varint  number of axes that moved (version 2)
+//   byte    axis index, zigzag varint new value, for each of them (version 2)
+// A record with no changes marks the end of the recording.
+const char TRACE_MAGIC[4] = {'M', 'L', 'T', 'R'};
+const uint8_t TRACE_VERSION = 2;
+
+void write_varint(std::ostream& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.put((char)((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.put((char)v);
+}
+
+bool read_varint(std::istream& in, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = in.get();
+        if (c == EOF) return false;
+        v |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) return true;
+    }
+    return false;
+}
+
+// Signed values as varints: 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+struct TraceRecord {
+    int64_t time_us; // since the start of the recording
+    ButtonMask buttons;
+    AxisValues axes;
+};
+
+// Records every state change of the wrapped source while passing it through
+class TraceRecorder : public InputSource {
+public:
+    explicit TraceRecorder(InputSource& source) : inner(source) {}
+    ~TraceRecorder() { close(); }
+
+    bool open(const std::string& filename) {
+        file.open(filename, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+        file.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        file.put((char)TRACE_VERSION);
+        last_time = Clock::now();
+        last = InputSnapshot();
+        return true;
+    }
+
+    // Writes the end marker
+    void close() {
+        if (!file.is_open()) return;
+        write_record(Clock::now(), last);
+        file.close();
+    }
+
+    void reseed() override { inner.reseed(); }
+    void wait(int timeout_ms) override { inner.wait(timeout_ms); }
+    void wake() override { inner.wake(); }
+
+    InputSnapshot snapshot() override {
+        InputSnapshot snap = inner.snapshot();
+        if (file.is_open() && (snap.buttons != last.buttons || snap.axes != last.axes)) write_record(snap.timestamp, snap);
+        return snap;
+    }
+
+private:
+    void write_record(Clock::time_point t, const InputSnapshot& snap) {
+        write_varint(file, (uint64_t)std::max<int64_t>(0, LatencyStats::micros(t - last_time)));
+        uint8_t toggled[MAX_BUTTONS];
+        int n = 0;
+        for (int b = 0; b < MAX_BUTTONS; ++b) {
+            if (snap.buttons.test(b) != last.buttons.test(b)) toggled[n++] = (uint8_t)b;
+        }
+        write_varint(file, (uint64_t)n);
+        file.write((const char*)toggled, n);
+        n = 0;
+        for (int a = 0; a < MAX_AXES; ++a) n += snap.axes[a] != last.axes[a];
+        write_varint(file, (uint64_t)n);
+        for (int a = 0; a < MAX_AXES; ++a) {
+            if (snap.axes[a] == last.axes[a]) continue;
+            file.put((char)a);
+            write_varint(file, zigzag(snap.axes[a]));
+        }
+        last_time = t;
+        last.buttons = snap.buttons;
+        last.axes = snap.axes;
+    }
+
+    InputSource& inner;
+    std::ofstream file;
+    Clock::time_point last_time;
+    InputSnapshot last; // state as of the last record
+};
+
+// Plays a recorded trace back on a virtual clock, so a replay runs as fast
+// as the translator can go. Time only moves inside wait(): to the next
+// recorded change or to the end of the requested timeout, whichever is first.
+class TraceInputSource : public InputSource {
+public:
+    bool load(const std::string& filename) {
+        records.clear();
+        std::ifstream file(filename, std::ios::binary);
+        char magic[sizeof(TRACE_MAGIC)];
+        if (!file.read(magic, sizeof(magic)) || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0) return false;
+        int version = file.get();
+        if (version < 1 || version > TRACE_VERSION) return false;
+        TraceRecord rec;
+        rec.time_us = 0;
+        rec.axes.fill(0);
+        uint64_t dt, n, value;
+        while (read_varint(file, dt)) {
+            if (!read_varint(file, n) || n > MAX_BUTTONS) return false;
+            rec.time_us += (int64_t)dt;
+            for (uint64_t i = 0; i < n; ++i) {
+                int b = file.get();
+                if (b == EOF) return false;
+                if (rec.buttons.test(b)) rec.buttons.reset(b);
+                else rec.buttons.set(b);
+            }
+            if (version >= 2) {
+                if (!read_varint(file, n) || n > MAX_AXES) return false;
+                for (uint64_t i = 0; i < n; ++i) {
+                    int a = file.get();
+                    if (a == EOF || a >= MAX_AXES || !read_varint(file, value)) return false;
+                    rec.axes[a] = (int16_t)unzigzag(value);
+                }
+            }
+            records.push_back(rec);
+        }
+        return !records.empty();
+    }
+
+    void reseed() override {
+        next = 0;
+        now_us = 0;
+        current = InputSnapshot();
+        apply_due();
+    }
+
+    void wait(int timeout_ms) override {
+        int64_t until = now_us + (int64_t)timeout_ms * 1000;
+        if (next < records.size() && records[next].time_us < until) until = records[next].time_us;
+        now_us = until;
+        apply_due();
+    }
+
+    InputSnapshot snapshot() override {
+        InputSnapshot snap = current;
+        snap.timestamp = now();
+        return snap;
+    }
+
+    void wake() override {}
+
+    // Virtual time; the replay starts at the clock's epoch
+    Clock::time_point now() const { return Clock::time_point() + std::chrono::microseconds(now_us); }
+    bool finished() const { return next >= records.size(); }
+    size_t record_count() const { return records.size(); }
+    int64_t duration_us() const { return records.empty() ? 0 : records.back().time_us; }
+
+private:
+    void apply_due() {
+        while (next < records.size() && records[next].time_us <= now_us) {
+            current.buttons = records[next].buttons;
+            current.axes = records[next].axes;
+            ++next;
+        }
+    }
+
+    std::vector<TraceRecord> records;
+    size_t next = 0;
+    int64_t now_us = 0;
+    InputSnapshot current;
+};
+
+// Known controller layouts. Each lever position is a code over a small field
+// of consecutive buttons (bit i = button first_button + i), so a matching
+// profile decodes with a shift, a mask and one lookup in a table generated
+// at compile time. The field must lie within one 64-bit word of ButtonMask.
+const int LEVER_POSITIONS = 15;
+typedef std::array<uint16_t, LEVER_POSITIONS> LayoutCodes;
+
+constexpr int popcount16(uint16_t v) {
+    int n = 0;
+    for (; v; v &= (uint16_t)(v - 1)) ++n;
+    return n;
+}
+
+// Same "largest subset wins" rule as match_combo, for every state of the field
+template <int Bits>
+constexpr std::array<int8_t, (1 << Bits)> build_layout_table(const LayoutCodes& codes) {
+    std::array<int8_t, (1 << Bits)> table{};
+    for (int state = 0; state < (1 << Bits); ++state) {
+        int best = -1;
+        int best_size = -1;
+        for (int i = 0; i < LEVER_POSITIONS; ++i) {
+            if ((state & codes[i]) == codes[i] && popcount16(codes[i]) > best_size) {
+                best = i;
+                best_size = popcount16(codes[i]);
+            }
+        }
+        table[state] = (int8_t)best;
+    }
+    return table;
+}
+
+struct KnownLayout {
+    const char* name;
+    int first_button;
+    int bits;
+    LayoutCodes codes;
+    const int8_t* table;
+};
+
+// Sanying OHC-PC01A (the default mapping): buttons 6-9
+constexpr LayoutCodes OHC_PC01A_CODES = {{8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15}};
+constexpr auto OHC_PC01A_TABLE = build_layout_table<4>(OHC_PC01A_CODES);
+static_assert(OHC_PC01A_TABLE[0] == -1 && OHC_PC01A_TABLE[5] == 9 && OHC_PC01A_TABLE[15] == 14, "OHC-PC01A table");
+
+const KnownLayout KNOWN_LAYOUTS[] = {
+    {"Sanying OHC-PC01A", 6, 4, OHC_PC01A_CODES, OHC_PC01A_TABLE.data()},
+};
+
+// Lever mappings a known layout corresponds to
+std::vector<std::set<int>> layout_mappings(const KnownLayout& layout) {
+    std::vector<std::set<int>> combos(LEVER_POSITIONS);
+    for (int i = 0; i < LEVER_POSITIONS; ++i) {
+        for (int bit = 0; bit < layout.bits; ++bit) {
+            if (layout.codes[i] & (1 << bit)) combos[i].insert(layout.first_button + bit);
+        }
+    }
+    return combos;
+}
+
+// Lever decoder: same "largest subset wins" rule as match_combo, but the
+// answer for every combination of the buttons used by the mappings is
+// precomputed once per profile load, so decode() only tests a few bits and
+// reads one table entry (no allocations on the hot path). Mappings that
+// match a known layout use that layout's compile-time table instead.
+class LeverDecoder {
+public:
+    void build(const std::vector<std::set<int>>& combos, bool use_known_layouts = true) {
+        layout = nullptr;
+        if (use_known_layouts) {
+            for (const auto& known : KNOWN_LAYOUTS) {
+                if (combos == layout_mappings(known)) {
+                    layout = &known;
+                    layout_word = known.first_button >> 6;
+                    layout_shift = known.first_button & 63;
+                    layout_mask = ((uint64_t)1 << known.bits) - 1;
+                    return;
+                }
+            }
+        }
+        relevant.clear();
+        combo_masks.clear();
+        combo_sizes.clear();
+        table.clear();
+        std::set<int> used;
+        for (const auto& combo : combos) {
+            ButtonMask m;
+            bool matchable = true;
+            for (int b : combo) {
+                if (b < 0 || b >= MAX_BUTTONS) matchable = false; // can never be pressed
+                else { m.set(b); used.insert(b); }
+            }
+            combo_masks.push_back(m);
+            combo_sizes.push_back(matchable ? (int)combo.size() : -1);
+        }
+        relevant.assign(used.begin(), used.end());
+        use_table = relevant.size() <= MAX_TABLE_BITS;
+        if (!use_table) return; // too many buttons involved, decode() scans combo_masks instead
+        table.assign((size_t)1 << relevant.size(), -1);
+        for (size_t state = 0; state < table.size(); ++state) {
+            ButtonMask pressed;
+            for (size_t i = 0; i < relevant.size(); ++i) {
+                if (state & ((size_t)1 << i)) pressed.set(relevant[i]);
+            }
+            table[state] = (int16_t)scan(pressed);
+        }
+    }
+
+    int decode(const ButtonMask& pressed) const {
+        if (layout) return layout->table[(pressed.bits[layout_word] >> layout_shift) & layout_mask];
+        if (!use_table) return scan(pressed);
+        size_t state = 0;
+        for (size_t i = 0; i < relevant.size(); ++i) {
+            if (pressed.test(relevant[i])) state |= (size_t)1 << i;
+        }
+        return table[state];
+    }
+
+private:
+    static const size_t MAX_TABLE_BITS = 12; // 4096 entries
+
+    int scan(const ButtonMask& pressed) const {
+        int best = -1;
+        int best_size = -1;
+        for (size_t i = 0; i < combo_masks.size(); ++i) {
+            if (combo_sizes[i] > best_size && pressed.contains(combo_masks[i])) {
+                best = (int)i;
+                best_size = combo_sizes[i];
+            }
+        }
+        return best;
+    }
+
+    std::vector<int> relevant;         // button indices referenced by any mapping
+    std::vector<int16_t> table;        // lever index for each state of the relevant buttons
+    std::vector<ButtonMask> combo_masks;
+    std::vector<int> combo_sizes;      // -1 = mapping references an out-of-range button
+    bool use_table = false;
+    const KnownLayout* layout = nullptr;
+    int layout_word = 0;
+    int layout_shift = 0;
+    uint64_t layout_mask = 0;
+};
+
+// Glitch filter in front of the lever debounce. The 15 positions are
+// physically ordered, so between two samples the lever can only move a
+// notch or two; a reading that jumps further (contacts bouncing while the
+// lever crosses them) needs more confirmation before it counts. Moves toward
+// power and toward brake can need a different number of samples.
+// Samples are taken on a fixed FILTER_SAMPLE_MS clock rather than per input
+// event, so the sample counts are times and do not depend on how often the
+// device reports: a count of N means the same reading for N-1 intervals.
+const int FILTER_SAMPLE_MS = 1;
+
+class LeverFilter {
+public:
+    void configure(int power_samples_, int brake_samples_, int max_jump_, int jump_samples_) {
+        power_samples = std::max(1, power_samples_);
+        brake_samples = std::max(1, brake_samples_);
+        max_jump = std::max(1, max_jump_);
+        jump_samples = std::max(1, jump_samples_);
+        stable = candidate = last_sample = -1;
+        count = 0;
+        sample_time = Clock::time_point();
+    }
+
+    // Feed the decoded reading at 'now' (-1 = between contacts); returns the
+    // filtered position, -1 until one has been confirmed. A reading equal to
+    // the last one only counts as a new sample once FILTER_SAMPLE_MS has
+    // passed; any other reading breaks the run straight away.
+    int update(int idx, Clock::time_point now) {
+        if (idx < 0) {
+            count = 0; // breaks the run of identical samples
+            return stable;
+        }
+        if (idx == candidate) {
+            if (count > 0 && now - sample_time < std::chrono::milliseconds(FILTER_SAMPLE_MS)) return stable;
+            ++count;
+        } else {
+            candidate = idx;
+            count = 1;
+            // Plausible if close to the previous sample or to the confirmed position
+            int jump = std::abs(idx - (last_sample >= 0 ? last_sample : stable));
+            if (stable >= 0) jump = std::min(jump, std::abs(idx - stable));
+            if (jump > max_jump && (last_sample >= 0 || stable >= 0)) required = jump_samples;
+            else if (stable < 0) required = std::max(power_samples, brake_samples);
+            else required = idx > stable ? power_samples : brake_samples;
+        }
+        sample_time = now;
+        last_sample = idx;
+        if (candidate != stable && count >= required) stable = candidate;
+        return stable;
+    }
+
+    // A reading is waiting for more samples
+    bool pending() const { return candidate >= 0 && candidate != stable; }
+
+    // Milliseconds from 'now' until the next sample is due (a full interval
+    // after a break in the run)
+    long long next_sample_ms(Clock::time_point now) const {
+        Clock::duration left = sample_time + std::chrono::milliseconds(FILTER_SAMPLE_MS) - now;
+        if (count == 0 || left <= Clock::duration::zero()) return FILTER_SAMPLE_MS;
+        return std::chrono::ceil<std::chrono::milliseconds>(left).count();
+    }
+
+private:
+    int power_samples = 1;
+    int brake_samples = 1;
+    int max_jump = 14;
+    int jump_samples = 1;
+    int stable = -1;
+    int candidate = -1;
+    int last_sample = -1;
+    int count = 0;
+    int required = 1;
+    Clock::time_point sample_time; // when the last sample was counted
+};
+
+// Maps a raw analog lever axis onto the 15 positions using the calibrated
+// value of each notch. The boundaries sit halfway between neighbouring
+// notches and are found by binary search. To leave the current notch the
+// axis has to pass a boundary by 'hysteresis', so noise at a boundary cannot
+// make the position flicker, and readings within 'deadzone' of a boundary
+// count as "between notches" (-1), like a button lever between contacts.
+class AxisQuantiser {
+public:
+    void build(const std::vector<int>& notches, int hysteresis_, int deadzone_) {
+        bounds.clear();
+        positions.clear();
+        current = -1;
+        hysteresis = std::max(0, hysteresis_);
+        deadzone = std::max(0, deadzone_);
+        if ((int)notches.size() != LEVER_POSITIONS) return;
+        // Sorting by value handles axes that increase toward brake or toward power
+        std::vector<std::pair<int, int>> sorted;
+        for (int i = 0; i < LEVER_POSITIONS; ++i) sorted.push_back(std::make_pair(notches[i], i));
+        std::sort(sorted.begin(), sorted.end());
+        for (size_t k = 0; k < sorted.size(); ++k) {
+            positions.push_back(sorted[k].second);
+            if (k > 0) bounds.push_back((sorted[k - 1].first + sorted[k].first) / 2);
+        }
+    }
+
+    bool ready() const { return !positions.empty(); }
+
+    int quantise(int raw) {
+        if (!ready()) return -1;
+        if (current >= 0) {
+            long lo = current == 0 ? LONG_MIN : (long)bounds[current - 1] - hysteresis;
+            long hi = current == (int)bounds.size() ? LONG_MAX : (long)bounds[current] + hysteresis;
+            if (raw >= lo && raw < hi) return positions[current];
+        }
+        int k = (int)(std::upper_bound(bounds.begin(), bounds.end(), raw) - bounds.begin());
+        if ((k > 0 && raw - bounds[k - 1] < deadzone) || (k < (int)bounds.size() && bounds[k] - raw <= deadzone)) return -1;
+        current = k;
+        return positions[k];
+    }
+
+private:
+    std::vector<int> bounds;    // ascending boundaries between neighbouring notches
+    std::vector<int> positions; // lever position for each interval (bounds.size() + 1)
+    int current = -1;           // interval of the last position returned
+    int hysteresis = 0;
+    int deadzone = 0;
+};
+
+// Config structure and defaults
+struct Config {
+    int debounce_ms = 30;
+    int up_down_delay_ms = 25;
+    int mouse_scroll_delay_ms = 20;
+    int key_hold_time_ms = 10; // New: how long to hold arrow key down (ms)
+    int last_mode = 0;
+    int last_joystick = 0;
+    std::string joystick_guid; // SDL GUID of the mascon; last_joystick is only a fallback
+    std::string extra_joysticks; // space-separated GUIDs of devices 1, 2, ... (other handles, pedal boxes)
+    std::string language = "en";
+    std::string profile = "Default"; // Profile name
+    // Lever mapping: 15 positions, each a set of button indices
+    std::vector<std::set<int>> lever_mappings;
+    // Optional pedal mappings
+    int big_horn_button = -1; // -1 = not set
+    int small_horn_button = -1; // -1 = not set
+    int credit_button = -1;    // -1 = not set (LeftShift+C)
+    int test_menu_button = -1; // -1 = not set (RightShift)
+    int debug_mission_button = -1; // -1 = not set (LeftShift)
+    std::vector<int> lever_keycodes; // New: keycode for each lever position (mode 2)
+    // Burst mode: a multi-notch lever move is sent all at once instead of one
+    // step per debounce period. 0 ms spacing = a single batched SendInput.
+    bool burst_mode = false;
+    int burst_spacing_ms = 0;
+    // Lever glitch filter (see LeverFilter): consecutive identical samples
+    // needed for a move toward power / brake, the largest plausible move
+    // between two samples, and the samples needed for a larger jump
+    bool lever_filter = false;
+    int filter_power_samples = 3;
+    int filter_brake_samples = 2;
+    int filter_max_jump = 2;
+    int filter_jump_samples = 8;
+    // Analog lever: SDL axis index (-1 = the lever is read from buttons),
+    // calibrated raw value of each of the 15 notches, and the quantiser bands
+    int lever_axis = -1;
+    std::vector<int> axis_notches;
+    int axis_hysteresis = 600;
+    int axis_deadzone = 0;
+    Config() {
+        // Default lever mapping (original ordered_combos)
+        lever_mappings = {
+            {9}, {8}, {8,9}, {7}, {7,9}, {7,8}, {7,8,9}, {6}, {6,9}, {6,8},
+            {6,8,9}, {6,7}, {6,7,9}, {6,7,8}, {6,7,8,9}
+        };
+        big_horn_button = -1;
+        small_horn_button = -1;
+        credit_button = -1;
+        test_menu_button = -1;
+        debug_mission_button = -1;
+        language = "en";
+        profile = "Default";
+        lever_keycodes = std::vector<int>(15, 0); // Default: all 0 (no key)
+    }
+};
+
+const Config default_config{};
+
+// One "key=value" setting of the profile file. Exactly one of the member
+// pointers is set, according to 'kind'; ints are clamped to min_value.
+// InputRef: a logical button or axis index, written "index" or "device:index"
+enum class ConfigFieldKind : uint8_t { Int, Bool, String, IntList, InputRef };
+
+struct ConfigField {
+    std::string_view key;
+    ConfigFieldKind kind;
+    int Config::* int_value;
+    bool Config::* bool_value;
+    std::string Config::* string_value;
+    std::vector<int> Config::* list_value;
+    int min_value; // Int/InputRef: allowed range
+    int max_value;
+    int stride; // InputRef: DEVICE_BUTTON_STRIDE or DEVICE_AXIS_STRIDE
+};
+
+constexpr ConfigField int_field(std::string_view key, int Config::* value, int min_value = INT_MIN, int max_value = INT_MAX) {
+    return ConfigField{key, ConfigFieldKind::Int, value, nullptr, nullptr, nullptr, min_value, max_value, 0};
+}
+constexpr ConfigField bool_field(std::string_view key, bool Config::* value) {
+    return ConfigField{key, ConfigFieldKind::Bool, nullptr, value, nullptr, nullptr, 0, 0, 0};
+}
+constexpr ConfigField string_field(std::string_view key, std::string Config::* value) {
+    return ConfigField{key, ConfigFieldKind::String, nullptr, nullptr, value, nullptr, 0, 0, 0};
+}
+constexpr ConfigField list_field(std::string_view key, std::vector<int> Config::* value) {
+    return ConfigField{key, ConfigFieldKind::IntList, nullptr, nullptr, nullptr, value, 0, 0, 0};
+}
+constexpr ConfigField input_field(std::string_view key, int Config::* value, int stride) {
+    return ConfigField{key, ConfigFieldKind::InputRef, value, nullptr, nullptr, nullptr, -1, MAX_DEVICES * stride - 1, stride};
+}
+
+// Upper limit for the timing settings, in ms
+const int MAX_TIMING_MS = 1000;
+
+// All settings, in the order save_config writes them
+constexpr ConfigField CONFIG_FIELDS[] = {
+    int_field("debounce_ms", &Config::debounce_ms, 1, MAX_TIMING_MS),
+    int_field("up_down_delay_ms", &Config::up_down_delay_ms, 1, MAX_TIMING_MS),
+    int_field("mouse_scroll_delay_ms", &Config::mouse_scroll_delay_ms, 1, MAX_TIMING_MS),
+    int_field("key_hold_time_ms", &Config::key_hold_time_ms, 1, MAX_TIMING_MS),
+    int_field("last_mode", &Config::last_mode, 0, 2),
+    int_field("last_joystick", &Config::last_joystick, 0),
+    string_field("joystick_guid", &Config::joystick_guid),
+    string_field("extra_joysticks", &Config::extra_joysticks),
+    string_field("language", &Config::language),
+    input_field("big_horn_button", &Config::big_horn_button, DEVICE_BUTTON_STRIDE),
+    input_field("small_horn_button", &Config::small_horn_button, DEVICE_BUTTON_STRIDE),
+    input_field("credit_button", &Config::credit_button, DEVICE_BUTTON_STRIDE),
+    input_field("test_menu_button", &Config::test_menu_button, DEVICE_BUTTON_STRIDE),
+    input_field("debug_mission_button", &Config::debug_mission_button, DEVICE_BUTTON_STRIDE),
+    string_field("profile", &Config::profile),
+    bool_field("burst_mode", &Config::burst_mode),
+    int_field("burst_spacing_ms", &Config::burst_spacing_ms, 0, MAX_TIMING_MS),
+    bool_field("lever_filter", &Config::lever_filter),
+    int_field("filter_power_samples", &Config::filter_power_samples, 1, 100),
+    int_field("filter_brake_samples", &Config::filter_brake_samples, 1, 100),
+    int_field("filter_max_jump", &Config::filter_max_jump, 1, LEVER_POSITIONS - 1),
+    int_field("filter_jump_samples", &Config::filter_jump_samples, 1, 100),
+    input_field("lever_axis", &Config::lever_axis, DEVICE_AXIS_STRIDE),
+    list_field("axis_notches", &Config::axis_notches),
+    int_field("axis_hysteresis", &Config::axis_hysteresis, 0, 65535),
+    int_field("axis_deadzone", &Config::axis_deadzone, 0, 65535),
+};
+constexpr int CONFIG_FIELD_COUNT = (int)(sizeof(CONFIG_FIELDS) / sizeof(CONFIG_FIELDS[0]));
+
+// Keys are looked up through a perfect hash: FNV-1a with a seed, picked at
+// compile time, for which no two keys share a slot. A lookup is one hash,
+// one table read and one string compare.
+const int CONFIG_HASH_SLOTS = 64; // power of two
+static_assert(CONFIG_FIELD_COUNT < CONFIG_HASH_SLOTS, "too many config keys for the hash table");
+
+constexpr uint32_t config_key_hash(std::string_view key, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : key) h = (h ^ (uint8_t)c) * 16777619u;
+    return h;
+}
+
+constexpr uint32_t find_config_hash_seed() {
+    for (uint32_t seed = 0;; ++seed) {
+        bool used[CONFIG_HASH_SLOTS] = {};
+        bool perfect = true;
+        for (const auto& field : CONFIG_FIELDS) {
+            uint32_t slot = config_key_hash(field.key, seed) & (CONFIG_HASH_SLOTS - 1);
+            if (used[slot]) { perfect = false; break; }
+            used[slot] = true;
+        }
+        if (perfect) return seed;
+    }
+}
+
+constexpr uint32_t CONFIG_HASH_SEED = find_config_hash_seed();
+
+constexpr std::array<int8_t, CONFIG_HASH_SLOTS> build_config_index() {
+    std::array<int8_t, CONFIG_HASH_SLOTS> index{};
+    for (auto& slot : index) slot = -1;
+    for (int i = 0; i < CONFIG_FIELD_COUNT; ++i) {
+        index[config_key_hash(CONFIG_FIELDS[i].key, CONFIG_HASH_SEED) & (CONFIG_HASH_SLOTS - 1)] = (int8_t)i;
+    }
+    return index;
+}
+
+constexpr std::array<int8_t, CONFIG_HASH_SLOTS> CONFIG_INDEX = build_config_index();
+
+const ConfigField* find_config_field(std::string_view key) {
+    int i = CONFIG_INDEX[config_key_hash(key, CONFIG_HASH_SEED) & (CONFIG_HASH_SLOTS - 1)];
+    return (i >= 0 && CONFIG_FIELDS[i].key == key) ? &CONFIG_FIELDS[i] : nullptr;
+}
+
+// Section headers for the per-position tables; lines inside are "position=value"
+const std::string_view LEVER_MAPPINGS_SECTION = "[lever_mappings]";
+const std::string_view LEVER_KEYCODES_SECTION = "[lever_keycodes]";
+
+// The profile file's contents for these settings
+std::string serialize_config(const Config& cfg) {
+    std::ostringstream ofs;
+    ofs << "# Mascon Lever Input Translator Config\n";
+    for (const auto& field : CONFIG_FIELDS) {
+        ofs << field.key << '=';
+        switch (field.kind) {
+        case ConfigFieldKind::Int: ofs << cfg.*field.int_value; break;
+        case ConfigFieldKind::InputRef: ofs << format_input_ref(cfg.*field.int_value, field.stride); break;
+        case ConfigFieldKind::Bool: ofs << (cfg.*field.bool_value ? 1 : 0); break;
+        case ConfigFieldKind::String: ofs << cfg.*field.string_value; break;
+        case ConfigFieldKind::IntList: {
+            const std::vector<int>& list = cfg.*field.list_value;
+            for (size_t i = 0; i < list.size(); ++i) ofs << (i ? " " : "") << list[i];
+            break;
+        }
+        }
+        ofs << '\n';
+    }
+    ofs << "# Lever mappings: position (0 = B9, 9 = Neutral, 14 = P5) = space-separated buttons (device:button for devices after the first)\n";
+    ofs << LEVER_MAPPINGS_SECTION << '\n';
+    for (size_t i = 0; i < cfg.lever_mappings.size(); ++i) {
+        ofs << i << '=';
+        bool first = true;
+        for (int b : cfg.lever_mappings[i]) {
+            ofs << (first ? "" : " ") << format_input_ref(b, DEVICE_BUTTON_STRIDE);
+            first = false;
+        }
+        ofs << '\n';
+    }
+    ofs << "# Lever keycodes: position = virtual-key code sent in Lever-to-Key mode (0 = none)\n";
+    ofs << LEVER_KEYCODES_SECTION << '\n';
+    for (size_t i = 0; i < cfg.lever_keycodes.size(); ++i) ofs << i << '=' << cfg.lever_keycodes[i] << '\n';
+    return ofs.str();
+}
+
+// Helper to read a whole file into one buffer
+bool read_file(const std::string& filename, std::string& contents) {
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs) return false;
+    ifs.seekg(0, std::ios::end);
+    contents.assign((size_t)std::max<std::streamoff>(0, ifs.tellg()), '\0');
+    ifs.seekg(0, std::ios::beg);
+    ifs.read(&contents[0], (std::streamsize)contents.size());
+    contents.resize((size_t)ifs.gcount());
+    return true;
+}
+
+// Replaces the file so that it is either the old or the new version, never
+// a mix: the bytes go to a temporary file next to it, which is then renamed
+// over the original. Does nothing if the file already holds these bytes.
+bool write_file_atomically(const std::string& filename, const std::string& bytes) {
+    std::string current;
+    if (read_file(filename, current) && current == bytes) return true;
+    const std::string tmp = filename + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size() && fflush(f) == 0;
+#ifndef _WIN32
+    ok = ok && fsync(fileno(f)) == 0;
+#endif
+    ok = fclose(f) == 0 && ok;
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tmp.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    ok = ok && rename(tmp.c_str(), filename.c_str()) == 0;
+#endif
+    if (!ok) std::remove(tmp.c_str());
+    return ok;
+}
+
+// How long the config writer waits for more saves before writing
+const int SAVE_COALESCE_MS = 200;
+
+// Background writer for profile files. The settings menu saves after
+// nearly every change, often the same file twice in a row; save() only
+// queues the serialized bytes (the latest per file wins) and the writer
+// thread writes them out once the burst is over. Anything that reads,
+// lists or deletes profile files calls flush() first.
+class ConfigWriter {
+public:
+    ~ConfigWriter() { stop(); }
+
+    void save(const std::string& filename, std::string bytes) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!worker.joinable() && !stopping) worker = std::thread(&ConfigWriter::run, this);
+        if (stopping) { // shutting down: no thread left to hand this to
+            written[filename] = bytes;
+            write_file_atomically(filename, bytes);
+            return;
+        }
+        if (pending.empty()) first_pending = Clock::now();
+        pending[filename] = std::move(bytes);
+        cv.notify_all();
+    }
+
+    // Blocks until every queued save is on disk
+    void flush() {
+        std::unique_lock<std::mutex> lock(mtx);
+        ++flush_waiters;
+        cv.notify_all();
+        cv.wait(lock, [this] { return pending.empty() && !writing; });
+        --flush_waiters;
+    }
+
+    // Writes what is queued and joins the writer thread
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+            cv.notify_all();
+        }
+        if (worker.joinable()) worker.join();
+    }
+
+    // True if 'bytes' is what this writer last wrote to 'filename', so a
+    // change to the file seen by a watcher was our own save
+    bool wrote(const std::string& filename, const std::string& bytes) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = written.find(filename);
+        return it != written.end() && it->second == bytes;
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (true) {
+            cv.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (pending.empty()) return; // stopping
+            cv.wait_until(lock, first_pending + std::chrono::milliseconds(SAVE_COALESCE_MS),
+                          [this] { return stopping || flush_waiters > 0; });
+            std::map<std::string, std::string> batch;
+            batch.swap(pending);
+            // Recorded before writing so a watcher woken by the rename
+            // already sees these as ours
+            for (const auto& file : batch) written[file.first] = file.second;
+            writing = true;
+            lock.unlock();
+            for (const auto& file : batch) write_file_atomically(file.first, file.second);
+            lock.lock();
+            writing = false;
+            cv.notify_all();
+        }
+    }
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread worker;
+    std::map<std::string, std::string> pending; // file name -> contents
+    std::map<std::string, std::string> written; // file name -> contents last written
+    Clock::time_point first_pending;
+    int flush_waiters = 0;
+    bool writing = false;
+    bool stopping = false;
+};
+
+ConfigWriter& config_writer() {
+    static ConfigWriter instance;
+    return instance;
+}
+
+void index_saved_profile(const std::string& filename, const Config& cfg);
+
+void save_config(const Config& cfg, const std::string& filename) {
+    config_writer().save(filename, serialize_config(cfg));
+    index_saved_profile(filename, cfg);
+}
+
+// Makes queued saves visible to readers of the profile files
+void flush_config_saves() {
+    config_writer().flush();
+}
+
+// Helper to trim spaces and tabs from both ends
+std::string_view trim_view(std::string_view s) {
+    size_t first = s.find_first_not_of(" \t");
+    if (first == std::string_view::npos) return std::string_view();
+    return s.substr(first, s.find_last_not_of(" \t") - first + 1);
+}
+
+// Helper to parse a leading integer; false if s does not start with one
+bool parse_int(std::string_view s, int& value) {
+    return std::from_chars(s.data(), s.data() + s.size(), value).ec == std::errc();
+}
+
+// Helper to parse whitespace-separated integers, stopping at the first non-number
+template <typename F>
+void parse_int_list(std::string_view s, F add) {
+    while (true) {
+        s = trim_view(s);
+        if (s.empty()) return;
+        int value;
+        auto result = std::from_chars(s.data(), s.data() + s.size(), value);
+        if (result.ec != std::errc()) return;
+        add(value);
+        s.remove_prefix(result.ptr - s.data());
+    }
+}
+
+// Strict check for a value coming from outside the profile file (the
+// daemon's set command): it must parse completely and be in range, where
+// apply_config_field falls back to the default or clamps
+bool valid_config_value(const ConfigField& field, std::string_view val) {
+    switch (field.kind) {
+    case ConfigFieldKind::Int: {
+        int value;
+        auto result = std::from_chars(val.data(), val.data() + val.size(), value);
+        return result.ec == std::errc() && result.ptr == val.data() + val.size() && value >= field.min_value && value <= field.max_value;
+    }
+    case ConfigFieldKind::InputRef: {
+        int value;
+        return parse_input_ref(val, field.stride, value) && val.empty() && value >= field.min_value && value <= field.max_value;
+    }
+    case ConfigFieldKind::Bool:
+        return val == "0" || val == "1";
+    case ConfigFieldKind::String:
+        return true;
+    case ConfigFieldKind::IntList:
+        while (!(val = trim_view(val)).empty()) {
+            int value;
+            auto result = std::from_chars(val.data(), val.data() + val.size(), value);
+            if (result.ec != std::errc()) return false;
+            val.remove_prefix(result.ptr - val.data());
+            if (!val.empty() && val[0] != ' ' && val[0] != '\t') return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+// Helper to parse whitespace-separated button references, stopping at the first invalid one
+template <typename F>
+void parse_button_list(std::string_view s, F add) {
+    while (true) {
+        s = trim_view(s);
+        int b;
+        if (s.empty() || !parse_input_ref(s, DEVICE_BUTTON_STRIDE, b)) return;
+        add(b);
+    }
+}
+
+void apply_config_field(Config& cfg, const ConfigField& field, std::string_view val) {
+    switch (field.kind) {
+    case ConfigFieldKind::Int: {
+        int value;
+        if (val.empty() || !parse_int(val, value)) cfg.*field.int_value = default_config.*field.int_value;
+        else cfg.*field.int_value = std::min(field.max_value, std::max(field.min_value, value));
+        break;
+    }
+    case ConfigFieldKind::InputRef: {
+        int value;
+        if (val.empty() || !parse_input_ref(val, field.stride, value)) cfg.*field.int_value = default_config.*field.int_value;
+        else cfg.*field.int_value = std::min(field.max_value, std::max(field.min_value, value));
+        break;
+    }
+    case ConfigFieldKind::Bool:
+        cfg.*field.bool_value = val.empty() ? default_config.*field.bool_value : val != "0";
+        break;
+    case ConfigFieldKind::String:
+        cfg.*field.string_value = val.empty() ? default_config.*field.string_value : std::string(val);
+        break;
+    case ConfigFieldKind::IntList: {
+        std::vector<int>& list = cfg.*field.list_value;
+        list.clear();
+        parse_int_list(val, [&list](int v) { list.push_back(v); });
+        break;
+    }
+    }
+}
+
+// Reads the whole file once and parses it in a single pass over
+// string_views. Settings may appear in any order; unknown keys are ignored.
+// Files written before the keyed sections existed list the 15 lever
+// mappings and then the 15 lever keycodes as bare lines, which are still
+// read positionally.
+bool load_config(Config& cfg, const std::string& filename) {
+    flush_config_saves();
+    std::string buffer;
+    if (!read_file(filename, buffer)) return false;
+
+    enum Section { SETTINGS, MAPPINGS, KEYCODES } section = SETTINGS;
+    int loaded = 0;
+    int legacy_lines = 0; // bare lines of the old positional format
+    cfg.lever_mappings = default_config.lever_mappings;
+    cfg.lever_keycodes = std::vector<int>(LEVER_POSITIONS, 0);
+    std::string_view rest(buffer);
+    while (!rest.empty()) {
+        size_t eol = rest.find('\n');
+        std::string_view line = rest.substr(0, eol);
+        rest.remove_prefix(eol == std::string_view::npos ? rest.size() : eol + 1);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line.empty() || line[0] == '#') continue;
+        if (line == LEVER_MAPPINGS_SECTION) { section = MAPPINGS; continue; }
+        if (line == LEVER_KEYCODES_SECTION) { section = KEYCODES; continue; }
+        size_t eq = line.find('=');
+        if (eq == std::string_view::npos) {
+            // Old format: 15 mapping lines, then 15 keycode lines
+            int n = legacy_lines++;
+            if (n < LEVER_POSITIONS) {
+                std::set<int>& combo = cfg.lever_mappings[n];
+                combo.clear();
+                parse_button_list(line, [&combo](int b) { combo.insert(b); });
+            } else if (n < 2 * LEVER_POSITIONS) {
+                int vk;
+                cfg.lever_keycodes[n - LEVER_POSITIONS] = parse_int(trim_view(line), vk) ? vk : 0;
+            }
+            continue;
+        }
+        std::string_view key = trim_view(line.substr(0, eq));
+        std::string_view val = trim_view(line.substr(eq + 1));
+        int pos;
+        if (section != SETTINGS && parse_int(key, pos)) {
+            if (pos < 0 || pos >= LEVER_POSITIONS) continue;
+            if (section == MAPPINGS) {
+                std::set<int>& combo = cfg.lever_mappings[pos];
+                combo.clear();
+                parse_button_list(val, [&combo](int b) { combo.insert(b); });
+            } else {
+                int vk;
+                cfg.lever_keycodes[pos] = parse_int(val, vk) ? vk : 0;
+            }
+            continue;
+        }
+        if (const ConfigField* field = find_config_field(key)) {
+            apply_config_field(cfg, *field, val);
+            ++loaded;
+        }
+    }
+    return loaded >= 5; // still require at least 5 for legacy support
+}
+
+// File the given profile is stored in ("Default" keeps the original name)
+std::string profile_filename(const std::string& profile) {
+    return (profile == "Default") ? "mascon_translator.cfg" : (profile + ".cfg");
+}
+
+std::string profile_filename(const Config& cfg) {
+    return profile_filename(cfg.profile);
+}
+
+// Profile stored in 'filename', or false if it is not a profile file
+bool profile_from_filename(const std::string& filename, std::string& profile) {
+    if (filename == "mascon_translator.cfg") {
+        profile = "Default";
+        return true;
+    }
+    if (filename.size() <= 4 || filename.compare(filename.size() - 4, 4, ".cfg") != 0) return false;
+    profile = filename.substr(0, filename.size() - 4);
+    return profile != "Default"; // Default.cfg is never read ("Default" is mascon_translator.cfg)
+}
+
+// Every profile, parsed, in memory. The directory is scanned once; after
+// that a watcher thread notes which .cfg files changed and only those are
+// re-read, the next time the index is used. Saves and deletes made by this
+// program update it directly. Listing and switching profiles therefore
+// don't touch the disk. Used from the main thread only (the watcher thread
+// just records file names).
+class ProfileIndex {
+public:
+    ~ProfileIndex() { stop(); }
+
+    // Initial scan; then keep up with changes made by other programs
+    void start() {
+        if (worker.joinable()) return;
+        sync();
+        worker = std::thread(&ProfileIndex::run, this);
+    }
+
+    void stop() {
+        watcher.stop();
+        if (worker.joinable()) worker.join();
+    }
+
+    // All profiles: "Default" first, then the others sorted by name
+    const std::vector<std::string>& names() {
+        sync();
+        if (order_dirty) {
+            ordered.assign(1, "Default");
+            std::vector<std::string> others;
+            for (const auto& entry : entries) {
+                if (entry.first != "Default") others.push_back(entry.first);
+            }
+            std::sort(others.begin(), others.end());
+            ordered.insert(ordered.end(), others.begin(), others.end());
+            order_dirty = false;
+        }
+        return ordered;
+    }
+
+    bool contains(const std::string& name) {
+        sync();
+        return name == "Default" || entries.count(name) > 0;
+    }
+
+    // Settings of a profile, or nullptr if it does not exist or failed to load
+    const Config* find(const std::string& name) {
+        sync();
+        auto it = entries.find(name);
+        return (it != entries.end() && it->second.valid) ? &it->second.config : nullptr;
+    }
+
+    void store(const std::string& filename, const Config& cfg) {
+        std::string name;
+        if (!profile_from_filename(filename, name)) return;
+        if (entries.find(name) == entries.end()) order_dirty = true;
+        Entry& entry = entries[name];
+        entry.config = cfg;
+        entry.config.profile = name;
+        entry.valid = true;
+        entry.mtime = 0; // not on disk yet; the watcher will report the write
+        entry.size = -1;
+    }
+
+    void forget(const std::string& name) {
+        if (entries.erase(name)) order_dirty = true;
+    }
+
+private:
+    struct Entry {
+        Config config;
+        bool valid = false; // false: listed, but the file could not be parsed
+        time_t mtime = 0;
+        long long size = -1;
+    };
+
+    // Re-read what the watcher reported, or everything on the first use
+    // (and if the OS dropped change events)
+    void sync() {
+        std::set<std::string> changed;
+        bool full;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            changed.swap(dirty);
+            full = rescan_needed || !worker.joinable();
+            rescan_needed = false;
+        }
+        // Profiles stored before ConfigWriter has written them would look
+        // deleted (or stale) on disk
+        if (full || !changed.empty()) flush_config_saves();
+        if (full) {
+            std::set<std::string> present;
+            for (const std::string& fname : list_files_with_extension(".cfg")) {
+                std::string name;
+                if (!profile_from_filename(fname, name)) continue;
+                present.insert(name);
+                refresh(fname, name, false);
+            }
+            for (auto it = entries.begin(); it != entries.end();) {
+                if (present.count(it->first)) {
+                    ++it;
+                } else {
+                    it = entries.erase(it);
+                    order_dirty = true;
+                }
+            }
+        }
+        for (const std::string& fname : changed) {
+            std::string name;
+            if (profile_from_filename(fname, name)) refresh(fname, name, true);
+        }
+    }
+
+    // A scan skips files whose size and time stamp are unchanged; a change
+    // event always re-reads (time stamps can be too coarse to tell)
+    void refresh(const std::string& filename, const std::string& name, bool changed) {
+        struct stat st;
+        if (stat(filename.c_str(), &st) != 0) {
+            forget(name);
+            return;
+        }
+        auto it = entries.find(name);
+        if (it != entries.end() && !changed && it->second.mtime == st.st_mtime && it->second.size == (long long)st.st_size) return;
+        if (it == entries.end()) order_dirty = true;
+        Entry& entry = entries[name];
+        Config cfg;
+        entry.valid = load_config(cfg, filename);
+        cfg.profile = name; // the file name is what identifies the profile
+        entry.config = cfg;
+        entry.mtime = st.st_mtime;
+        entry.size = (long long)st.st_size;
+    }
+
+    void run() {
+        std::vector<std::string> names;
+        while (watcher.wait(names)) {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (const auto& name : names) {
+                if (name.empty()) rescan_needed = true;
+                else dirty.insert(name);
+            }
+        }
+    }
+
+    std::unordered_map<std::string, Entry> entries; // by profile name
+    std::vector<std::string> ordered;
+    bool order_dirty = true;
+    std::mutex mtx;
+    std::set<std::string> dirty; // file names reported by the watcher
+    bool rescan_needed = false;
+    PlatformFileWatcher watcher;
+    std::thread worker;
+};
+
+ProfileIndex& profile_index() {
+    static ProfileIndex instance;
+    return instance;
+}
+
+void index_saved_profile(const std::string& filename, const Config& cfg) {
+    profile_index().store(filename, cfg);
+}
+
+// Helper to print colored text in the console
+void print_colored(const std::string& text, WORD color) {
+    console().write_colored(text, color);
+}
+
+// Message IDs: FNV-1a of the English key, usable at compile time
+constexpr uint32_t message_hash(std::string_view key) {
+    uint32_t h = 2166136261u;
+    for (char c : key) h = (h ^ (uint8_t)c) * 16777619u;
+    return h;
+}
+
+// A message key with its ID already computed, see TR_KEY
+struct MessageKey {
+    std::string_view text;
+    uint32_t hash;
+};
+
+// Hashes a literal message key at compile time, for tr() calls that run on
+// every redraw of the header and the settings menu: tr(TR_KEY("Press "), lang)
+#define TR_KEY(text) (MessageKey{text, std::integral_constant<uint32_t, message_hash(text)>::value})
+
+// Translations interned into flat arrays when a language is loaded. Each
+// key of the English file (and any extra key of the active language) gets
+// a message ID; texts[id] already holds the active language's text, or the
+// English one where that language has no entry. A lookup is one hash, a
+// short probe of an open-addressed table and one compare, with no
+// allocation.
+class TranslationCatalog {
+public:
+    typedef std::vector<std::pair<std::string, std::string>> Entries;
+
+    // Entries: (key, text) pairs of std::string or std::string_view
+    template <typename E1, typename E2>
+    void build(const E1& english, const E2& active) {
+        keys.clear();
+        texts.clear();
+        size_t size = 16;
+        while (size < 2 * (english.size() + active.size())) size *= 2;
+        slots.assign(size, Slot{0, -1});
+        for (const auto& e : english) set(e.first, e.second);
+        for (const auto& e : active) set(e.first, e.second);
+    }
+
+    // nullptr if no language file has this key
+    const std::string* find(std::string_view key) const { return find(key, message_hash(key)); }
+
+    // Same, with the key's message_hash() already known
+    const std::string* find(std::string_view key, uint32_t h) const {
+        if (slots.empty()) return nullptr;
+        const size_t mask = slots.size() - 1;
+        for (size_t i = h & mask;; i = (i + 1) & mask) {
+            if (slots[i].id < 0) return nullptr;
+            if (slots[i].hash == h && keys[slots[i].id] == key) return &texts[slots[i].id];
+        }
+    }
+
+    size_t size() const { return keys.size(); }
+    const std::string& key(size_t id) const { return keys[id]; }
+    const std::string& text(size_t id) const { return texts[id]; }
+
+    // Untranslated keys are shown as-is; they are interned once so tr()
+    // can return a reference for them too
+    const std::string& intern_missing(std::string_view key) {
+        std::lock_guard<std::mutex> lock(missing_mtx);
+        auto it = missing.find(key);
+        if (it == missing.end()) it = missing.insert(std::string(key)).first;
+        return *it;
+    }
+
+private:
+    struct Slot {
+        uint32_t hash;
+        int32_t id; // -1 = empty
+    };
+
+    void set(std::string_view key, std::string_view text) {
+        const uint32_t h = message_hash(key);
+        const size_t mask = slots.size() - 1;
+        size_t i = h & mask;
+        for (; slots[i].id >= 0; i = (i + 1) & mask) {
+            if (slots[i].hash == h && keys[slots[i].id] == key) {
+                texts[slots[i].id].assign(text.data(), text.size()); // the active language overrides English
+                return;
+            }
+        }
+        slots[i] = Slot{h, (int32_t)keys.size()};
+        keys.push_back(std::string(key));
+        texts.push_back(std::string(text));
+    }
+
+    std::vector<Slot> slots; // power of two, at most half full
+    std::vector<std::string> keys;
+    std::vector<std::string> texts; // index = message ID
+    std::mutex missing_mtx;
+    std::set<std::string, std::less<>> missing;
+};
+
+TranslationCatalog translations; // Global translation catalog
+
+// Helper to read the string entries of lang/lang_xx.json
+TranslationCatalog::Entries read_language_file(const std::string& lang_code) {
+    TranslationCatalog::Entries entries;
+    std::ifstream ifs("lang/lang_" + lang_code + ".json");
+    if (!ifs) return entries;
+    nlohmann::json json;
+    try {
+        ifs >> json;
+    } catch (const std::exception&) {
+        return entries;
+    }
+    for (auto it = json.begin(); it != json.end(); ++it) {
+        if (it.value().is_string()) entries.push_back(std::make_pair(it.key(), it.value().get<std::string>()));
+    }
+    return entries;
+}
+
+// Precompiled language pack, written by --build-langpacks from
+// lang/lang_xx.json and lang/lang_en.json. It already contains the English
+// fallback, so loading a language reads exactly one file and parses no JSON.
+// Layout: "MLLP", a version byte, the entry count, then per entry the
+// offset and length of its key and of its text in the string data that
+// follows (all little-endian uint32).
+const char LANGPACK_MAGIC[4] = {'M', 'L', 'L', 'P'};
+const uint8_t LANGPACK_VERSION = 1;
+const size_t LANGPACK_HEADER_SIZE = sizeof(LANGPACK_MAGIC) + 1 + 4;
+const size_t LANGPACK_ENTRY_SIZE = 4 * 4;
+
+std::string language_pack_path(const std::string& lang_code) {
+    return "lang/lang_" + lang_code + ".lpk";
+}
+
+// Modification time of 'filename', 0 if it does not exist
+time_t file_mtime(const std::string& filename) {
+    struct stat st;
+    return stat(filename.c_str(), &st) == 0 ? st.st_mtime : 0;
+}
+
+// A pack is only used while it is newer than both JSON files it was built
+// from, so an edited translation is never hidden by a stale pack
+bool language_pack_current(const std::string& lang_code) {
+    time_t pack = file_mtime(language_pack_path(lang_code));
+    return pack > file_mtime("lang/lang_" + lang_code + ".json") && pack > file_mtime("lang/lang_en.json");
+}
+
+void put_u32(std::string& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back((char)((v >> (8 * i)) & 0xFF));
+}
+
+uint32_t get_u32(const char* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) v |= (uint32_t)(uint8_t)p[i] << (8 * i);
+    return v;
+}
+
+std::string serialize_language_pack(const TranslationCatalog& catalog) {
+    std::string index, data;
+    for (size_t id = 0; id < catalog.size(); ++id) {
+        put_u32(index, (uint32_t)data.size());
+        put_u32(index, (uint32_t)catalog.key(id).size());
+        data += catalog.key(id);
+        put_u32(index, (uint32_t)data.size());
+        put_u32(index, (uint32_t)catalog.text(id).size());
+        data += catalog.text(id);
+    }
+    std::string pack(LANGPACK_MAGIC, sizeof(LANGPACK_MAGIC));
+    pack.push_back((char)LANGPACK_VERSION);
+    put_u32(pack, (uint32_t)catalog.size());
+    return pack + index + data;
+}
+
+// Entries point into 'pack'; false if it is not a valid language pack
+bool parse_language_pack(const std::string& pack, std::vector<std::pair<std::string_view, std::string_view>>& entries) {
+    entries.clear();
+    if (pack.size() < LANGPACK_HEADER_SIZE || memcmp(pack.data(), LANGPACK_MAGIC, sizeof(LANGPACK_MAGIC)) != 0) return false;
+    if ((uint8_t)pack[sizeof(LANGPACK_MAGIC)] != LANGPACK_VERSION) return false;
+    const uint64_t count = get_u32(pack.data() + sizeof(LANGPACK_MAGIC) + 1);
+    if (count > (pack.size() - LANGPACK_HEADER_SIZE) / LANGPACK_ENTRY_SIZE) return false;
+    const char* index = pack.data() + LANGPACK_HEADER_SIZE;
+    const std::string_view data(index + count * LANGPACK_ENTRY_SIZE, pack.size() - LANGPACK_HEADER_SIZE - count * LANGPACK_ENTRY_SIZE);
+    auto slice = [&data](const char* p, std::string_view& out) {
+        uint64_t off = get_u32(p), len = get_u32(p + 4);
+        if (off + len > data.size()) return false;
+        out = data.substr(off, len);
+        return true;
+    };
+    entries.resize(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        const char* e = index + i * LANGPACK_ENTRY_SIZE;
+        if (!slice(e, entries[i].first) || !slice(e + 8, entries[i].second)) return false;
+    }
+    return true;
+}
+
+// Loads translations from lang/lang_xx.lpk if it has been built since the
+// JSON files last changed, otherwise from lang/lang_xx.json with lang/lang_en.json for anything that language
+// does not translate
+void load_translations(const std::string& lang_code) {
+    std::string pack;
+    std::vector<std::pair<std::string_view, std::string_view>> entries;
+    if (language_pack_current(lang_code) && read_file(language_pack_path(lang_code), pack) && parse_language_pack(pack, entries)) {
+        translations.build(entries, TranslationCatalog::Entries());
+        return;
+    }
+    TranslationCatalog::Entries english = read_language_file("en");
+    translations.build(english, lang_code == "en" ? TranslationCatalog::Entries() : read_language_file(lang_code));
+}
+
+// --build-langpacks: compile every lang/lang_xx.json into lang/lang_xx.lpk
+int build_langpacks_main() {
+    const TranslationCatalog::Entries english = read_language_file("en");
+    if (english.empty()) {
+        std::cerr << "Could not read lang/lang_en.json\n";
+        return 1;
+    }
+    std::vector<std::string> files = list_files_with_extension(".json", "lang");
+    std::sort(files.begin(), files.end());
+    int failed = 0;
+    for (const std::string& fname : files) {
+        if (fname.compare(0, 5, "lang_") != 0) continue;
+        const std::string code = fname.substr(5, fname.size() - 5 - 5);
+        TranslationCatalog catalog;
+        catalog.build(english, code == "en" ? TranslationCatalog::Entries() : read_language_file(code));
+        const std::string pack = serialize_language_pack(catalog);
+        const std::string path = language_pack_path(code);
+        if (write_file_atomically(path, pack)) {
+            std::cout << "lang/" << fname << " -> " << path << " (" << catalog.size() << " strings, " << pack.size() << " bytes)\n";
+        } else {
+            std::cerr << "Could not write " << path << "\n";
+            ++failed;
+        }
+    }
+    return failed ? 1 : 0;
+}
+
+// Translation lookup; the returned reference stays valid until the next
+// load_translations()
+template<typename... Args>
+const std::string& tr(std::string_view text, Args&&... args) {
+    if (const std::string* found = translations.find(text)) return *found;
+    return translations.intern_missing(text);
+}
+
+// Same, skipping the hash for keys made with TR_KEY
+template<typename... Args>
+const std::string& tr(const MessageKey& key, Args&&... args) {
+    if (const std::string* found = translations.find(key.text, key.hash)) return *found;
+    return translations.intern_missing(key.text);
+}
+
+// Lever position names, index = lever position
+const std::vector<std::string> LEVER_NAMES = {
+    "B9", "B8", "B7", "B6", "B5", "B4", "B3", "B2", "B1", "Neutral",
+    "P1", "P2", "P3", "P4", "P5"
+};
+
+// Messages the input thread can log
+enum class LogEvent : uint8_t {
+    BigHornDown, BigHornUp, SmallHornDown, SmallHornUp,
+    TestMenuDown, TestMenuUp, DebugMissionDown, DebugMissionUp,
+    CreditSent, LeverKeySent, LeverStep, Neutral, ConfigReloaded,
+    ProfileSwitched, DeviceRemoved, DeviceReconnected
+};
+
+// Compact log record; formatting happens on the logger thread
+struct LogRecord {
+    LogEvent event;
+    int a; // LeverStep: from position, LeverKeySent: virtual-key code, Device*: device
+    int b; // LeverStep: to position
+    std::string text; // ProfileSwitched: profile name (short, so normally no allocation)
+};
+
+// Helper to tell devices apart in messages once more than one is in use
+std::string device_label(int device) {
+    return device > 0 ? "[Device " + std::to_string(device) + "] " : "";
+}
+
+// Asynchronous console logger for the input thread. log() only copies a
+// record into a single-producer/single-consumer lock-free ring buffer; a
+// background thread does the formatting and the (slow) coloured console
+// output. If the console falls behind, records are dropped and counted
+// rather than stalling input.
+class AsyncLogger {
+public:
+    ~AsyncLogger() { stop(); }
+
+    void start(const std::string& language) {
+        lang = language;
+        if (running.exchange(true)) return;
+        worker = std::thread(&AsyncLogger::run, this);
+    }
+
+    // Drains what is queued and joins the logger thread
+    void stop() {
+        if (!running.exchange(false)) return;
+        wake();
+        worker.join();
+    }
+
+    // Producer side (input thread only)
+    void log(LogEvent event, int a = 0, int b = 0) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= CAPACITY) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        LogRecord& rec = ring[h & (CAPACITY - 1)];
+        rec.event = event;
+        rec.a = a;
+        rec.b = b;
+        rec.text.clear();
+        publish(h);
+    }
+
+    // Same, for the events that carry a name
+    void log(LogEvent event, const std::string& text) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= CAPACITY) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        LogRecord& rec = ring[h & (CAPACITY - 1)];
+        rec.event = event;
+        rec.a = rec.b = 0;
+        rec.text = text;
+        publish(h);
+    }
+
+    // Wait until everything logged so far has been printed. Call before the
+    // main thread writes to the console or changes the language.
+    void flush() {
+        while (running.load() && tail.load(std::memory_order_acquire) != head.load(std::memory_order_acquire)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    // Only while the input thread is paused and the logger is flushed
+    void set_language(const std::string& language) { lang = language; }
+
+    uint64_t dropped_count() const { return dropped.load(std::memory_order_relaxed); }
+
+    // Drops everything queued without printing; only while the logger
+    // thread is not running (benchmarks)
+    size_t discard_pending() {
+        size_t n = 0;
+        LogRecord rec;
+        while (pop(rec)) ++n;
+        return n;
+    }
+
+private:
+    static const size_t CAPACITY = 1024; // must be a power of two
+
+    // Makes slot h visible and wakes the logger thread only when the ring
+    // goes from empty to non-empty. head/tail use seq_cst here and in pop()
+    // so either we see the drained tail or the consumer sees the new head.
+    void publish(size_t h) {
+        head.store(h + 1);
+        if (tail.load() == h) wake();
+    }
+
+    void wake() {
+        { std::lock_guard<std::mutex> lock(wake_mutex); }
+        wake_cv.notify_one();
+    }
+
+    void run() {
+        uint64_t reported_drops = 0;
+        while (true) {
+            bool was_running = running.load();
+            LogRecord rec;
+            while (pop(rec)) print(rec);
+            uint64_t drops = dropped.load(std::memory_order_relaxed);
+            if (drops != reported_drops) {
+                print_colored("[Log] " + std::to_string(drops - reported_drops) + " messages dropped\n", COLOR_WARNING);
+                reported_drops = drops;
+            }
+            if (!was_running) return;
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            wake_cv.wait(lock, [this] { return !running.load() || tail.load() != head.load(); });
+        }
+    }
+
+    bool pop(LogRecord& rec) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load()) return false;
+        rec = std::move(ring[t & (CAPACITY - 1)]);
+        tail.store(t + 1);
+        return true;
+    }
+
+    void print(const LogRecord& rec) {
+        switch (rec.event) {
+        case LogEvent::BigHornDown: print_colored("[Big Horn Pedal] Enter DOWN\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY); break;
+        case LogEvent::BigHornUp: print_colored("[Big Horn Pedal] Enter UP\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY); break;
+        case LogEvent::SmallHornDown: print_colored("[Small Horn Pedal] Spacebar DOWN\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY); break;
+        case LogEvent::SmallHornUp: print_colored("[Small Horn Pedal] Spacebar UP\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY); break;
+        case LogEvent::TestMenuDown: print_colored("[Test Menu] RightShift DOWN\n", FOREGROUND_PINK | FOREGROUND_INTENSITY); break;
+        case LogEvent::TestMenuUp: print_colored("[Test Menu] RightShift UP\n", FOREGROUND_PINK | FOREGROUND_INTENSITY); break;
+        case LogEvent::DebugMissionDown: print_colored("[Debug Mission] LeftShift DOWN\n", FOREGROUND_RED | FOREGROUND_INTENSITY); break;
+        case LogEvent::DebugMissionUp: print_colored("[Debug Mission] LeftShift UP\n", FOREGROUND_RED | FOREGROUND_INTENSITY); break;
+        case LogEvent::CreditSent: print_colored("[Credit] [ key sent\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY); break;
+        case LogEvent::LeverKeySent: print_colored("[Lever-to-Key] Sent key VK=0x" + std::to_string(rec.a) + "\n", COLOR_PINK); break;
+        case LogEvent::Neutral: print_colored(tr("Neutral position!", lang) + "\n", FOREGROUND_PINK | FOREGROUND_INTENSITY); break;
+        case LogEvent::ConfigReloaded: print_colored(tr("Profile file changed, settings reloaded.", lang) + "\n", FOREGROUND_CYAN | FOREGROUND_INTENSITY); break;
+        case LogEvent::ProfileSwitched: print_colored(tr("Switched to profile: ", lang) + rec.text + "\n", COLOR_INFO); break;
+        // Device 0 is the mascon; extra devices may be anything (pedals, button boxes)
+        case LogEvent::DeviceRemoved:
+            print_colored(device_label(rec.a) + tr(rec.a == 0 ? "Mascon disconnected. Plug it back in to continue." : "Device disconnected. Plug it back in to use it again.", lang) + "\n",
+                          FOREGROUND_RED | FOREGROUND_INTENSITY);
+            break;
+        case LogEvent::DeviceReconnected:
+            print_colored(device_label(rec.a) + tr(rec.a == 0 ? "Mascon reconnected." : "Device reconnected.", lang) + "\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            break;
+        case LogEvent::LeverStep: {
+            bool down = rec.b > rec.a;
+            print_colored(LEVER_NAMES[rec.a] + " -> " + LEVER_NAMES[rec.b] + " : ", down ? (FOREGROUND_YELLOW | FOREGROUND_INTENSITY) : (FOREGROUND_CYAN | FOREGROUND_INTENSITY));
+            print_colored(down ? "v" : "^", down ? (FOREGROUND_GREEN | FOREGROUND_INTENSITY) : (FOREGROUND_PINK | FOREGROUND_INTENSITY));
+            std::cout << std::endl;
+            break;
+        }
+        }
+    }
+
+    LogRecord ring[CAPACITY];
+    std::atomic<size_t> head{0}; // next slot to write (producer)
+    std::atomic<size_t> tail{0}; // next slot to read (consumer)
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> running{false};
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+    std::string lang;
+    std::thread worker;
+};
+
+// Enhanced language select function with AI translation notice
+std::string select_language(const std::string& current) {
+    while (true) {
+        std::cout << "\n--- Language Selection ---\n";
+        std::cout << "NOTICE: All translations were done by AI and have not been checked for accuracy.\n";
+        std::cout << "Current: ";
+        if (current == "en") std::cout << "English";
+        else if (current == "es") std::cout << "Spanish";
+        else if (current == "de") std::cout << "German";
+        else if (current == "ko") std::cout << "Korean";
+        else if (current == "zh") std::cout << "Chinese";
+        else if (current == "ja") std::cout << "Japanese";
+        else if (current == "fr") std::cout << "French";
+        else if (current == "it") std::cout << "Italian";
+        else if (current == "pt") std::cout << "Portuguese";
+        else if (current == "ru") std::cout << "Russian";
+        else if (current == "tr") std::cout << "Turkish";
+        else if (current == "ar") std::cout << "Arabic";
+        else if (current == "hi") std::cout << "Hindi";
+        else if (current == "vi") std::cout << "Vietnamese";
+        else if (current == "id") std::cout << "Indonesian";
+        else if (current == "ms") std::cout << "Malay";
+        else std::cout << current;
+        std::cout << "\nAvailable languages:\n";
+        std::cout << " 1. English (en) (English)\n";
+        std::cout << " 2. Spanish (es) (Español)\n";
+        std::cout << " 3. German (de) (Deutsch)\n";
+        std::cout << " 4. Korean (ko) (한국어)\n";
+        std::cout << " 5. Chinese (zh) (中文)\n";
+        std::cout << " 6. Japanese (ja) (日本語)\n";
+        std::cout << " 7. French (fr) (Français)\n";
+        std::cout << " 8. Italian (it) (Italiano)\n";
+        std::cout << " 9. Portuguese (pt) (Português)\n";
+        std::cout << "10. Russian (ru) (Русский)\n";
+        std::cout << "11. Turkish (tr) (Türkçe)\n";
+        std::cout << "12. Arabic (ar) (العربية)\n";
+        std::cout << "13. Hindi (hi) (हिन्दी)\n";
+        std::cout << "14. Vietnamese (vi) (Tiếng Việt)\n";
+        std::cout << "15. Indonesian (id) (Bahasa Indonesia)\n";
+        std::cout << "16. Malay (ms) (Bahasa Melayu)\n";
+        std::cout << "Select language (1-16): ";
+        std::string input;
+        std::getline(std::cin, input);
+        if (input == "1") return "en";
+        if (input == "2") return "es";
+        if (input == "3") return "de";
+        if (input == "4") return "ko";
+        if (input == "5") return "zh";
+        if (input == "6") return "ja";
+        if (input == "7") return "fr";
+        if (input == "8") return "it";
+        if (input == "9") return "pt";
+        if (input == "10") return "ru";
+        if (input == "11") return "tr";
+        if (input == "12") return "ar";
+        if (input == "13") return "hi";
+        if (input == "14") return "vi";
+        if (input == "15") return "id";
+        if (input == "16") return "ms";
+        std::cout << "Invalid selection. Please choose 1-16.\n";
+    }
+}
+
+// Add language select to settings_menu
+// Remap calibration: each position is sampled for a while instead of
+// trusting the single reading taken when Enter is pressed
+const int CALIBRATION_WINDOW_MS = 500;
+const int CALIBRATION_SAMPLE_MS = 1;
+const int CALIBRATION_MIN_SHARE = 90; // % of samples the chosen combination should have
+
+// How often each button combination was read while holding one position,
+// most frequent first
+typedef std::vector<std::pair<std::set<int>, int>> ComboHistogram;
+
+// Helper to sample the buttons for CALIBRATION_WINDOW_MS
+ComboHistogram sample_lever_combos(SDL_Joystick* joy) {
+    std::map<std::set<int>, int> counts;
+    auto end = Clock::now() + std::chrono::milliseconds(CALIBRATION_WINDOW_MS);
+    while (Clock::now() < end) {
+        InputSnapshot snap = read_snapshot(joy);
+        std::set<int> pressed;
+        for (int b = 0; b < MAX_BUTTONS; ++b) {
+            if (snap.buttons.test(b)) pressed.insert(b);
+        }
+        ++counts[pressed];
+        std::this_thread::sleep_for(std::chrono::milliseconds(CALIBRATION_SAMPLE_MS));
+    }
+    ComboHistogram hist(counts.begin(), counts.end());
+    std::stable_sort(hist.begin(), hist.end(), [](const std::pair<std::set<int>, int>& a, const std::pair<std::set<int>, int>& b) {
+        return a.second > b.second;
+    });
+    return hist;
+}
+
+// Same for an analog lever: the median of 'axis' over CALIBRATION_WINDOW_MS,
+// so a single noisy reading cannot end up as a notch value
+int sample_axis_median(SDL_Joystick* joy, int axis) {
+    std::vector<int> values;
+    auto end = Clock::now() + std::chrono::milliseconds(CALIBRATION_WINDOW_MS);
+    while (Clock::now() < end) {
+        values.push_back(read_snapshot(joy).axes[axis]);
+        std::this_thread::sleep_for(std::chrono::milliseconds(CALIBRATION_SAMPLE_MS));
+    }
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+// Calibrated notch values must run strictly one way from B9 to P5; equal or
+// out-of-order values mean two notches would overlap
+bool notches_ordered(const std::vector<int>& notches) {
+    bool rising = true, falling = true;
+    for (size_t i = 1; i < notches.size(); ++i) {
+        if (notches[i] <= notches[i - 1]) rising = false;
+        if (notches[i] >= notches[i - 1]) falling = false;
+    }
+    return rising || falling;
+}
+
+// Helper to format a button combination like "6 8" or "(none)"
+std::string format_combo(const std::set<int>& combo) {
+    if (combo.empty()) return "(none)";
+    std::string out;
+    for (int b : combo) out += (out.empty() ? "" : " ") + format_input_ref(b, DEVICE_BUTTON_STRIDE);
+    return out;
+}
+
+// After remapping: report positions sharing a combination, and how many of
+// each position's samples the new mapping would decode as another position
+void report_calibration(const std::vector<std::set<int>>& mappings, const std::vector<ComboHistogram>& samples, const std::string& lang) {
+    bool problems = false;
+    for (size_t i = 0; i < mappings.size(); ++i) {
+        for (size_t j = i + 1; j < mappings.size(); ++j) {
+            if (mappings[i] == mappings[j]) {
+                print_colored("  " + LEVER_NAMES[i] + " / " + LEVER_NAMES[j] + ": " + tr("same buttons", lang) + " (" + format_combo(mappings[i]) + ")\n", COLOR_ERROR);
+                problems = true;
+            }
+        }
+    }
+    LeverDecoder decoder;
+    decoder.build(mappings);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        int total = 0;
+        std::map<int, int> wrong; // decoded position -> samples
+        for (const auto& entry : samples[i]) {
+            ButtonMask mask;
+            for (int b : entry.first) mask.set(b);
+            int decoded = decoder.decode(mask);
+            if (decoded != (int)i) wrong[decoded] += entry.second;
+            total += entry.second;
+        }
+        for (const auto& w : wrong) {
+            if (w.first < 0) continue; // between contacts: ignored by the translator
+            print_colored("  " + LEVER_NAMES[i] + ": " + std::to_string(w.second * 100 / std::max(1, total)) + "% " +
+                          tr("of samples read as", lang) + " " + LEVER_NAMES[w.first] + "\n", COLOR_WARNING);
+            problems = true;
+        }
+    }
+    if (!problems) print_colored(tr("No ambiguous positions found.", lang) + "\n", COLOR_SUCCESS);
+}
+
+// Smallest movement (raw units) that counts as the lever when detecting its axis
+const int AXIS_DETECT_MIN_RANGE = 8000;
+
+// Helper to wait for Enter or Backspace, returning which was pressed.
+// 'while_waiting' runs every poll interval (e.g. to sample the joystick).
+int wait_for_enter_or_backspace(const std::function<void()>& while_waiting = nullptr) {
+    int key = 0;
+    console().set_raw(true);
+    while (true) {
+        if (console().kbhit()) {
+            key = console().getch();
+            if (key == KEY_CODE_ENTER || key == KEY_CODE_BACKSPACE) break;
+        }
+        if (while_waiting) while_waiting();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    console().set_raw(false);
+    return key;
+}
+
+void settings_menu(Config& cfg, const std::string& filename, int& mode, int& selected_id) {
+    auto get_profile_filename = [&cfg]() -> std::string { return profile_filename(cfg); };
+    save_config(cfg, get_profile_filename());
+    while (true) {
+        std::cout << "\n--- " << tr(TR_KEY("Settings"), cfg.language) << " Menu (" << tr(TR_KEY("Profile"), cfg.language) << ": " << cfg.profile << ") (press ";
+        print_colored(tr(TR_KEY("Enter"), cfg.language), FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+        std::cout << " to keep current value) ---\n";
+        std::cout << tr(TR_KEY("Current values:"), cfg.language) << std::endl;
+        print_colored("0. " + tr(TR_KEY("Profile"), cfg.language) + ": " + cfg.profile + "\n", FOREGROUND_CYAN);
+        print_colored("1. " + tr(TR_KEY("Joystick debounce ms: "), cfg.language), FOREGROUND_BLUE | FOREGROUND_INTENSITY);
+        std::cout << cfg.debounce_ms << "\n";
+        print_colored("2. " + tr(TR_KEY("Up/Down Arrow delay ms: "), cfg.language), FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+        std::cout << cfg.up_down_delay_ms << "\n";
+        print_colored("3. " + tr(TR_KEY("Mouse scroll delay ms: "), cfg.language), FOREGROUND_RED | FOREGROUND_BLUE | FOREGROUND_INTENSITY);
         std::cout << cfg.mouse_scroll_delay_ms << "\n";
-        print_colored("4. " + tr("Key hold time ms: ", cfg.language), FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
+        print_colored("4. " + tr(TR_KEY("Key hold time ms: "), cfg.language), FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
         std::cout << cfg.key_hold_time_ms << "\n";
-        print_colored("5. " + tr("Output mode: ", cfg.language), COLOR_WARNING);
-        std::cout << (mode == 0 ? tr("Arrow Keys", cfg.language) : mode == 1 ? tr("Mouse Scroll", cfg.language) : "Lever-to-Key") << "\n";
-        print_colored("6. " + tr("Joystick: ", cfg.language), FOREGROUND_RED | FOREGROUND_GREEN);
+        print_colored("5. " + tr(TR_KEY("Output mode: "), cfg.language), COLOR_WARNING);
+        std::cout << (mode == 0 ? tr(TR_KEY("Arrow Keys"), cfg.language) : mode == 1 ? tr(TR_KEY("Mouse Scroll"), cfg.language) : "Lever-to-Key") << "\n";
+        print_colored("6. " + tr(TR_KEY("Joystick: "), cfg.language), FOREGROUND_RED | FOREGROUND_GREEN);
         std::cout << selected_id << std::endl;
-        print_colored("7. " + tr("Remap lever positions", cfg.language) + "\n", FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY);
-        print_colored("8. " + tr("Other input mapping (horns, credit, test, debug)", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
-        print_colored("9. " + tr("Language", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+        print_colored("7. " + tr(TR_KEY("Remap lever positions"), cfg.language) + "\n", FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY);
+        print_colored("8. " + tr(TR_KEY("Other input mapping (horns, credit, test, debug)"), cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+        print_colored("9. " + tr(TR_KEY("Language"), cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
         if (mode == 2) {
-            print_colored("10. " + tr("Set lever-to-key mapping (mode 2)", cfg.language) + "\n", COLOR_PROMPT);
+            print_colored("10. " + tr(TR_KEY("Set lever-to-key mapping (mode 2)"), cfg.language) + "\n", COLOR_PROMPT);
         }
-        std::cout << tr("Enter number to change, '", cfg.language);
+        print_colored("11. " + tr(TR_KEY("Latency statistics"), cfg.language) + "\n", FOREGROUND_CYAN | FOREGROUND_INTENSITY);
+        print_colored("12. " + tr(TR_KEY("Burst mode: "), cfg.language), FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+        if (cfg.burst_mode) std::cout << tr(TR_KEY("On"), cfg.language) << " (" << cfg.burst_spacing_ms << " ms)\n";
+        else std::cout << tr(TR_KEY("Off"), cfg.language) << "\n";
+        print_colored("13. " + tr(TR_KEY("Lever glitch filter: "), cfg.language), FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
+        if (cfg.lever_filter) {
+            std::cout << tr(TR_KEY("On"), cfg.language) << " (" << cfg.filter_power_samples << "/" << cfg.filter_brake_samples << "/"
+                      << cfg.filter_max_jump << "/" << cfg.filter_jump_samples << ")\n";
+        } else {
+            std::cout << tr(TR_KEY("Off"), cfg.language) << "\n";
+        }
+        print_colored("14. " + tr(TR_KEY("Analog lever (axis): "), cfg.language), FOREGROUND_CYAN | FOREGROUND_INTENSITY);
+        if (cfg.lever_axis >= 0) std::cout << tr(TR_KEY("Axis "), cfg.language) << format_input_ref(cfg.lever_axis, DEVICE_AXIS_STRIDE) << "\n";
+        else std::cout << tr(TR_KEY("Off"), cfg.language) << "\n";
+        print_colored("15. " + tr(TR_KEY("Extra devices: "), cfg.language), FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+        std::cout << split_words(cfg.extra_joysticks).size() << "\n";
+        std::cout << tr(TR_KEY("Enter number to change, '"), cfg.language);
         print_colored("r", FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-        std::cout << tr("' to reset to default, '", cfg.language);
+        std::cout << tr(TR_KEY("' to reset to default, '"), cfg.language);
         print_colored("h", FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-        std::cout << tr("' for help, or '", cfg.language);
+        std::cout << tr(TR_KEY("' for help, or '"), cfg.language);
         print_colored("q", FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-        std::cout << tr("' to leave settings: ", cfg.language);
+        std::cout << tr(TR_KEY("' to leave settings: "), cfg.language);
         std::string input;
         std::getline(std::cin, input);
         if (input.empty()) continue;
@@ -419,558 +3396,1993 @@ void settings_menu(Config& cfg, const std::string& filename, int& mode, int& sel
         if (trimmed == "r" || trimmed == "R") {
             cfg = default_config;
             save_config(cfg, get_profile_filename());
-            print_colored(tr("Settings reset to default.", cfg.language) + "\n", FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            print_colored(tr("Settings reset to default.", cfg.language) + "\n", FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            continue;
+        }
+        if (trimmed == "h" || trimmed == "H") {
+            clear_screen();
+            // Colorful help menu (now translated)
+            print_colored("\n--- " + tr("Settings Help", cfg.language) + " ---\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            print_colored("1. " + tr("Joystick debounce ms", cfg.language) + "\n", FOREGROUND_BLUE | FOREGROUND_INTENSITY);
+            std::cout << "   - " << tr("Increase if the lever input \"teleports\" or jumps unexpectedly.", cfg.language) << "\n";
+            std::cout << "   - " << tr("Decrease to reduce input lag, but too low may cause instability.", cfg.language) << "\n\n";
+            print_colored("2. " + tr("Up/Down Arrow delay ms", cfg.language) + "\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            std::cout << "   - " << tr("Increase if some up/down arrow keypresses are not registered in your game.", cfg.language) << "\n";
+            std::cout << "   - " << tr("Decrease to reduce input lag, but too low may cause missed or repeated inputs.", cfg.language) << "\n\n";
+            print_colored("3. " + tr("Mouse scroll delay ms", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_BLUE | FOREGROUND_INTENSITY);
+            std::cout << "   - " << tr("Increase if some mouse scroll events are not registered in your game.", cfg.language) << "\n";
+            std::cout << "   - " << tr("Decrease to reduce input lag, but too low may cause missed or repeated scrolls.", cfg.language) << "\n\n";
+            print_colored("4. " + tr("Output mode", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            print_colored("   - 0: " + tr("Up/Down Arrow Keys", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_GREEN);
+            print_colored("   - 1: " + tr("Mouse Scroll", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_GREEN);
+            print_colored("   - 2: " + tr("Lever-to-Key", cfg.language) + "\n\n", FOREGROUND_RED | FOREGROUND_GREEN);
+            print_colored("5. " + tr("Change joystick", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+            std::cout << "   - " << tr("Select a different joystick by number.", cfg.language) << "\n\n";
+            print_colored("6. " + tr("Remap lever positions", cfg.language) + "\n", FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY);
+            std::cout << "   - " << tr("Move the lever to each position as prompted, then press Enter.", cfg.language) << "\n";
+            std::cout << "   - " << tr("Press Enter without moving to skip a position.", cfg.language) << "\n\n";
+            print_colored("7. " + tr("Other input mapping (horns, credit, test, debug)", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+            std::cout << "   - " << tr("Map joystick buttons to special functions like the big horn pedal (Enter), small horn pedal (Space), credit (coin), test menu (RightShift), and debug mission select (LeftShift).", cfg.language) << "\n\n";
+            print_colored("8. " + tr("Language", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+            std::cout << "   - " << tr("Change the language used for all menus and messages.", cfg.language) << "\n\n";
+            if (mode == 2) {
+                print_colored("9. " + tr("Set lever-to-key mapping (mode 2)", cfg.language) + "\n", COLOR_PROMPT);
+                std::cout << "   - " << tr("Assign a keyboard key to each lever position (for mode 2).", cfg.language) << "\n\n";
+            }
+            print_colored("10. " + tr("Latency statistics", cfg.language) + "\n", FOREGROUND_CYAN | FOREGROUND_INTENSITY);
+            std::cout << "   - " << tr("Shows how long each lever/button change takes to reach the game, to help tune the debounce and delay settings.", cfg.language) << "\n\n";
+            print_colored("11. " + tr("Burst mode", cfg.language) + "\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            std::cout << "   - " << tr("Sends a multi-notch lever move (e.g. N to B9) all at once instead of one step at a time. Not used in Lever-to-Key mode.", cfg.language) << "\n";
+            std::cout << "   - " << tr("Set a spacing above 0 ms if your game misses some of the steps.", cfg.language) << "\n\n";
+            print_colored("12. " + tr("Lever glitch filter", cfg.language) + "\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
+            std::cout << "   - " << tr("Ignores readings that jump further than the lever can physically move, so you can lower the debounce without the lever \"teleporting\".", cfg.language) << "\n";
+            std::cout << "   - " << tr("Shown as power samples / brake samples / largest normal jump / samples for a larger jump.", cfg.language) << "\n\n";
+            print_colored("13. " + tr("Analog lever (axis)", cfg.language) + "\n", FOREGROUND_CYAN | FOREGROUND_INTENSITY);
+            std::cout << "   - " << tr("For mascons that report the lever as an analog axis instead of buttons. Calibrate by moving the lever to each notch.", cfg.language) << "\n";
+            std::cout << "   - " << tr("Increase the hysteresis if the position flickers between two notches.", cfg.language) << "\n\n";
+            print_colored("14. " + tr("Extra devices", cfg.language) + "\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            std::cout << "   - " << tr("Use further joysticks together with the mascon, e.g. a separate brake handle or a horn pedal box. Their buttons are mapped as device:button (e.g. 1:3).", cfg.language) << "\n\n";
+            print_colored(tr("Adjust these settings to balance responsiveness and reliability for your setup.", cfg.language) + "\n", FOREGROUND_LIME | FOREGROUND_INTENSITY);
+            print_colored("---------------------\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            continue;
+        }
+        // Only parse as integer if input is all digits (after trimming)
+        bool is_number = !trimmed.empty() && std::all_of(trimmed.begin(), trimmed.end(), ::isdigit);
+        int opt = 0;
+        if (is_number) {
+            try { opt = std::stoi(trimmed); } catch (...) { opt = 0; }
+        } else {
+            print_colored(tr("Invalid input! Please enter a number, 'r', 'h', or 'q'.", cfg.language) + "\n\n", COLOR_ERROR);
+            continue;
+        }
+        if (opt == 1) {
+            print_colored("Enter new debounce ms (current: ", FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            std::cout << cfg.debounce_ms << "): ";
+            std::getline(std::cin, input);
+            if (!input.empty()) {
+                try {
+                    cfg.debounce_ms = std::max(1, std::stoi(input));
+                    save_config(cfg, get_profile_filename());
+                } catch (...) {
+                    print_colored(tr("Invalid input! Please enter a valid integer.", cfg.language) + "\n\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+                }
+            }
+        } else if (opt == 0) {
+            // Profile menu
+            while (true) {
+                clear_screen(); // Clear screen at the start of each profile menu loop
+                // List all available profiles ("Default" first, stored as mascon_translator.cfg)
+                const std::vector<std::string>& profiles = profile_index().names();
+                int current_idx = -1;
+                for (size_t i = 0; i < profiles.size(); ++i) {
+                    if (profiles[i] == cfg.profile) current_idx = (int)i;
+                }
+                print_colored("\n", FOREGROUND_CYAN);
+                print_colored("==============================\n", FOREGROUND_LIME | FOREGROUND_INTENSITY);
+                print_colored("   ", FOREGROUND_LIME | FOREGROUND_INTENSITY);
+                print_colored(tr("Profile", cfg.language), FOREGROUND_PINK | FOREGROUND_INTENSITY);
+                print_colored(" ", FOREGROUND_PINK | FOREGROUND_INTENSITY);
+                print_colored("Menu\n", FOREGROUND_PINK | FOREGROUND_INTENSITY);
+                print_colored("==============================\n", FOREGROUND_LIME | FOREGROUND_INTENSITY);
+                print_colored(tr("Available profiles:", cfg.language) + "\n", FOREGROUND_CYAN);
+                for (size_t i = 0; i < profiles.size(); ++i) {
+                    WORD color = (i % 2 == 0) ? FOREGROUND_LIME | FOREGROUND_INTENSITY : FOREGROUND_PINK | FOREGROUND_INTENSITY;
+                    if ((int)i == current_idx) {
+                        print_colored("* ", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
+                    } else {
+                        print_colored("  ", COLOR_DEFAULT);
+                    }
+                    print_colored(std::to_string(i + 1) + ". ", color);
+                    print_colored(profiles[i] + "\n", (profiles[i] == "Default") ? FOREGROUND_CYAN | FOREGROUND_INTENSITY : color);
+                }
+                print_colored("\n", FOREGROUND_CYAN);
+                print_colored(tr("Enter profile number to switch, 'n' for new, 'd' to delete, 'c' to copy/duplicate, 'r' to rename, or 'q' to cancel:", cfg.language), FOREGROUND_LIME | FOREGROUND_INTENSITY);
+                std::string profile_input;
+                std::getline(std::cin, profile_input);
+                if (profile_input == "q" || profile_input == "Q" || profile_input.empty()) { clear_screen(); break; }
+                // Switch profile by number
+                bool is_number = !profile_input.empty() && std::all_of(profile_input.begin(), profile_input.end(), ::isdigit);
+                if (is_number) {
+                    int idx = std::stoi(profile_input) - 1;
+                    if (idx >= 0 && idx < (int)profiles.size()) {
+                        if (profiles[idx] == cfg.profile) {
+                            clear_screen();
+                            print_colored(tr("Already using this profile.", cfg.language) + "\n", COLOR_INFO);
+                        } else {
+                            clear_screen();
+                            if (const Config* new_cfg = profile_index().find(profiles[idx])) {
+                                cfg = *new_cfg;
+                                print_colored(tr("Profile switched!", cfg.language) + "\n", COLOR_SUCCESS);
+                                // Do NOT save_config here! Only save after user changes settings.
+                            } else {
+                                print_colored(tr("Failed to load profile.", cfg.language) + "\n", COLOR_ERROR);
+                            }
+                        }
+                        continue;
+                    } else {
+                        clear_screen();
+                        print_colored(tr("Invalid profile number.", cfg.language) + "\n", COLOR_ERROR);
+                        continue;
+                    }
+                }
+                if (profile_input == "c" || profile_input == "C") {
+                    clear_screen();
+                    // Duplicate current profile with a suffix
+                    std::string base = cfg.profile;
+                    std::string new_profile = base + "_copy";
+                    int copy_idx = 2;
+                    while (profile_index().contains(new_profile)) {
+                        new_profile = base + "_copy" + std::to_string(copy_idx++);
+                    }
+                    Config new_cfg = cfg;
+                    new_cfg.profile = new_profile;
+                    save_config(new_cfg, new_profile + ".cfg");
+                    print_colored(tr("Profile duplicated!", cfg.language) + "\n", COLOR_SUCCESS);
+                    cfg.profile = new_profile;
+                    save_config(cfg, new_profile + ".cfg");
+                    continue;
+                } else if (profile_input == "n" || profile_input == "N") {
+                    clear_screen();
+                    print_colored(tr("Enter new profile name:", cfg.language), COLOR_PROMPT);
+                    std::string new_profile_name;
+                    std::getline(std::cin, new_profile_name);
+                    // Trim whitespace
+                    new_profile_name.erase(0, new_profile_name.find_first_not_of(" \t"));
+                    new_profile_name.erase(new_profile_name.find_last_not_of(" \t") + 1);
+                    if (new_profile_name.empty() || profile_index().contains(new_profile_name)) {
+                        print_colored(tr("Invalid or duplicate profile name.", cfg.language) + "\n", COLOR_ERROR);
+                        continue;
+                    }
+                    Config new_cfg = cfg;
+                    new_cfg.profile = new_profile_name;
+                    save_config(new_cfg, new_profile_name + ".cfg");
+                    print_colored(tr("New profile created!", cfg.language) + "\n", COLOR_SUCCESS);
+                    cfg.profile = new_profile_name;
+                    save_config(cfg, new_profile_name + ".cfg");
+                    continue;
+                } else if (profile_input == "r" || profile_input == "R") {
+                    clear_screen();
+                    print_colored(tr("Enter new profile name:", cfg.language), COLOR_PROMPT);
+                    std::string new_name;
+                    std::getline(std::cin, new_name);
+                    // Trim whitespace
+                    new_name.erase(0, new_name.find_first_not_of(" \t"));
+                    new_name.erase(new_name.find_last_not_of(" \t") + 1);
+                    if (new_name.empty() || new_name == cfg.profile || profile_index().contains(new_name)) {
+                        print_colored(tr("Invalid or duplicate profile name.", cfg.language) + "\n", COLOR_ERROR);
+                        continue;
+                    }
+                    // Rename: save config under new name, delete old file
+                    Config renamed_cfg = cfg;
+                    renamed_cfg.profile = new_name;
+                    save_config(renamed_cfg, new_name + ".cfg");
+                    std::string old_file = profile_filename(cfg);
+                    flush_config_saves(); // don't let a queued save recreate it
+                    std::remove(old_file.c_str());
+                    profile_index().forget(cfg.profile);
+                    print_colored(tr("Profile renamed!", cfg.language) + "\n", COLOR_SUCCESS);
+                    cfg.profile = new_name;
+                    save_config(cfg, new_name + ".cfg");
+                    continue;
+                } else if (profile_input == "d" || profile_input == "D") {
+                    clear_screen();
+                    if (cfg.profile == "Default") {
+                        print_colored(tr("Cannot delete the default profile.", cfg.language) + "\n", COLOR_ERROR);
+                        continue;
+                    }
+                    print_colored(tr("Are you sure you want to delete this profile? Type 'yes' to confirm:", cfg.language), COLOR_WARNING);
+                    std::string confirm;
+                    std::getline(std::cin, confirm);
+                    if (confirm != "yes") {
+                        print_colored(tr("Profile deletion cancelled.", cfg.language) + "\n", COLOR_INFO);
+                        continue;
+                    }
+                    std::string profile_cfg_file = profile_filename(cfg);
+                    flush_config_saves(); // don't let a queued save recreate it
+                    if (std::remove(profile_cfg_file.c_str()) == 0) {
+                        profile_index().forget(cfg.profile);
+                        print_colored(tr("Profile deleted!", cfg.language) + "\n", COLOR_SUCCESS);
+                        // Switch to Default profile after deletion
+                        auto it = std::find(profiles.begin(), profiles.end(), "Default");
+                        if (it != profiles.end()) {
+                            if (const Config* def_cfg = profile_index().find("Default")) {
+                                cfg = *def_cfg;
+                                print_colored(tr("Switched to Default profile.", cfg.language) + "\n", COLOR_INFO);
+                                save_config(cfg, "mascon_translator.cfg");
+                            } else {
+                                print_colored(tr("Failed to load Default profile.", cfg.language) + "\n", COLOR_ERROR);
+                            }
+                        } else {
+                            cfg = default_config;
+                            cfg.profile = "Default";
+                            save_config(cfg, "mascon_translator.cfg");
+                            print_colored(tr("Default profile recreated.", cfg.language) + "\n", COLOR_INFO);
+                        }
+                        continue;
+                    } else {
+                        print_colored(tr("Failed to delete profile file.", cfg.language) + "\n", COLOR_ERROR);
+                        continue;
+                    }
+                } else {
+                    clear_screen();
+                    print_colored(tr("Invalid option.", cfg.language) + "\n", COLOR_ERROR);
+                    continue;
+                }
+            }
+        } else if (opt == 2) {
+            print_colored("Enter new up/down delay ms (current: ", FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            std::cout << cfg.up_down_delay_ms << "): ";
+            std::getline(std::cin, input);
+            if (!input.empty()) {
+                try {
+                    cfg.up_down_delay_ms = std::max(1, std::stoi(input));
+                    save_config(cfg, get_profile_filename());
+                } catch (...) {
+                    print_colored(tr("Invalid input! Please enter a valid integer.", cfg.language) + "\n\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+                }
+            }
+        } else if (opt == 3) {
+            print_colored("Enter new mouse scroll delay ms (current: ", FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            std::cout << cfg.mouse_scroll_delay_ms << "): ";
+            std::getline(std::cin, input);
+            if (!input.empty()) {
+                try {
+                    cfg.mouse_scroll_delay_ms = std::max(1, std::stoi(input));
+                    save_config(cfg, get_profile_filename());
+                } catch (...) {
+                    print_colored(tr("Invalid input! Please enter a valid integer.", cfg.language) + "\n\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+                }
+            }
+        } else if (opt == 4) {
+            print_colored("Enter new key hold time ms (current: ", FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            std::cout << cfg.key_hold_time_ms << "): ";
+            std::getline(std::cin, input);
+            if (!input.empty()) {
+                try {
+                    cfg.key_hold_time_ms = std::max(1, std::stoi(input));
+                    save_config(cfg, get_profile_filename());
+                } catch (...) {
+                    print_colored(tr("Invalid input! Please enter a valid integer.", cfg.language) + "\n\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+                }
+            }
+        } else if (opt == 5) {
+            print_colored("Enter new output mode (", COLOR_PROMPT);
+            print_colored("0", COLOR_PROMPT);
+            std::cout << " = Arrow Keys, ";
+            print_colored("1", COLOR_PROMPT);
+            std::cout << " = Mouse Scroll, ";
+            print_colored("2", COLOR_PROMPT);
+            std::cout << " = Lever-to-Key), current: " << mode << ": ";
+            std::getline(std::cin, input);
+            if (!input.empty()) {
+                if (input == "0") mode = 0;
+                else if (input == "1") mode = 1;
+                else if (input == "2") mode = 2;
+                else print_colored(tr("Invalid input! Please enter 0, 1 or 2.", cfg.language) + "\n\n", COLOR_ERROR);
+                save_config(cfg, get_profile_filename());
+            }
+        } else if (opt == 6) {
+            // Devices may have been plugged in or out since startup, so list
+            // what is there now and remember which device each number meant
+            SDL_JoystickUpdate();
+            std::vector<SDL_JoystickID> listed;
+            print_colored("Available joysticks:\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
+            for (int i = 0; i < SDL_NumJoysticks(); ++i) {
+                listed.push_back(SDL_JoystickGetDeviceInstanceID(i));
+                print_colored(std::to_string(i), FOREGROUND_PINK | FOREGROUND_INTENSITY);
+                std::cout << ": " << SDL_JoystickNameForIndex(i) << std::endl;
+            }
+            print_colored("Enter new joystick number (current: ", FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            std::cout << selected_id << "): ";
+            std::getline(std::cin, input);
+            if (!input.empty()) {
+                try {
+                    int new_id = std::stoi(input);
+                    // Find the listed device again; its index may have shifted while typing
+                    SDL_JoystickUpdate();
+                    int found = -1;
+                    for (int i = 0; new_id >= 0 && new_id < (int)listed.size() && i < SDL_NumJoysticks(); ++i) {
+                        if (SDL_JoystickGetDeviceInstanceID(i) == listed[new_id]) found = i;
+                    }
+                    if (found >= 0) {
+                        selected_id = found;
+                        cfg.joystick_guid = joystick_guid(found);
+                        save_config(cfg, get_profile_filename());
+                    } else {
+                        print_colored(tr("Invalid joystick number.", cfg.language) + "\n\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+                    }
+                } catch (...) {
+                    print_colored(tr("Invalid input! Please enter a valid integer.", cfg.language) + "\n\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+                }
+            }
+        } else if (opt == 7) {
+            // Remap lever positions
+            static const std::vector<std::string> lever_names = {
+                "B9", "B8", "B7", "B6", "B5", "B4", "B3", "B2", "B1", "Neutral",
+                "P1", "P2", "P3", "P4", "P5"
+            };
+            print_colored("\nLever remapping: Move the lever to each position as prompted, then press Enter.\n", FOREGROUND_LIME);
+            print_colored("If you want to skip a position, just press Enter without moving.\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
+            print_colored("Press Backspace to go back to the previous position.\n", FOREGROUND_ORANGE);
+            SDL_Joystick* joy = SDL_JoystickOpen(selected_id);
+            if (!joy) {
+                print_colored(tr("Failed to open joystick for remapping.", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+                continue;
+            }
+            std::vector<std::set<int>> new_mappings;
+            std::vector<ComboHistogram> samples;
+            int i = 0;
+            while (i < (int)lever_names.size()) {
+                print_colored("Position ", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
+                print_colored(lever_names[i], FOREGROUND_PINK | FOREGROUND_INTENSITY);
+                std::cout << ": Move lever, then press Enter... (Backspace to go back) ";
+                std::cout.flush();
+                int key = wait_for_enter_or_backspace();
+                if (key == KEY_CODE_BACKSPACE) { // Backspace
+                    if (i > 0) {
+                        new_mappings.pop_back();
+                        samples.pop_back();
+                        --i;
+                        print_colored("\nWent back to previous position.\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
+                    } else {
+                        print_colored("\nAlready at the first position.\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+                    }
+                    continue;
+                }
+                print_colored("\n  " + tr("Sampling, hold the lever still...", cfg.language), COLOR_INFO);
+                std::cout.flush();
+                ComboHistogram hist = sample_lever_combos(joy);
+                int total = 0;
+                for (const auto& entry : hist) total += entry.second;
+                // The most frequent combination wins; the rest is contact bounce
+                int share = hist[0].second * 100 / std::max(1, total);
+                new_mappings.push_back(hist[0].first);
+                samples.push_back(hist);
+                print_colored("\n  Recorded buttons: ", FOREGROUND_LIME);
+                std::cout << format_combo(hist[0].first) << " (" << share << "% " << tr("of", cfg.language) << " " << total << " " << tr("samples", cfg.language) << ")";
+                if (hist.size() > 1) std::cout << ", " << tr("next", cfg.language) << ": " << format_combo(hist[1].first) << " (" << hist[1].second * 100 / std::max(1, total) << "%)";
+                std::cout << std::endl;
+                if (share < CALIBRATION_MIN_SHARE) {
+                    print_colored("  " + tr("Unstable reading. Press Backspace and record this position again if the lever was not moving.", cfg.language) + "\n", COLOR_WARNING);
+                }
+                ++i;
+            }
+            SDL_JoystickClose(joy);
+            print_colored("\n" + tr("Calibration check:", cfg.language) + "\n", FOREGROUND_LIME);
+            report_calibration(new_mappings, samples, cfg.language);
+            cfg.lever_mappings = new_mappings;
+            save_config(cfg, get_profile_filename());
+            print_colored("Remapping complete!\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
             continue;
-        }
-        if (trimmed == "h" || trimmed == "H") {
-            system("cls");
-            // Colorful help menu (now translated)
-            print_colored("\n--- " + tr("Settings Help", cfg.language) + " ---\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-            print_colored("1. " + tr("Joystick debounce ms", cfg.language) + "\n", FOREGROUND_BLUE | FOREGROUND_INTENSITY);
-            std::cout << "   - " << tr("Increase if the lever input \"teleports\" or jumps unexpectedly.", cfg.language) << "\n";
-            std::cout << "   - " << tr("Decrease to reduce input lag, but too low may cause instability.", cfg.language) << "\n\n";
-            print_colored("2. " + tr("Up/Down Arrow delay ms", cfg.language) + "\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-            std::cout << "   - " << tr("Increase if some up/down arrow keypresses are not registered in your game.", cfg.language) << "\n";
-            std::cout << "   - " << tr("Decrease to reduce input lag, but too low may cause missed or repeated inputs.", cfg.language) << "\n\n";
-            print_colored("3. " + tr("Mouse scroll delay ms", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_BLUE | FOREGROUND_INTENSITY);
-            std::cout << "   - " << tr("Increase if some mouse scroll events are not registered in your game.", cfg.language) << "\n";
-            std::cout << "   - " << tr("Decrease to reduce input lag, but too low may cause missed or repeated scrolls.", cfg.language) << "\n\n";
-            print_colored("4. " + tr("Output mode", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-            print_colored("   - 0: " + tr("Up/Down Arrow Keys", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_GREEN);
-            print_colored("   - 1: " + tr("Mouse Scroll", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_GREEN);
-            print_colored("   - 2: " + tr("Lever-to-Key", cfg.language) + "\n\n", FOREGROUND_RED | FOREGROUND_GREEN);
-            print_colored("5. " + tr("Change joystick", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
-            std::cout << "   - " << tr("Select a different joystick by number.", cfg.language) << "\n\n";
-            print_colored("6. " + tr("Remap lever positions", cfg.language) + "\n", FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY);
-            std::cout << "   - " << tr("Move the lever to each position as prompted, then press Enter.", cfg.language) << "\n";
-            std::cout << "   - " << tr("Press Enter without moving to skip a position.", cfg.language) << "\n\n";
-            print_colored("7. " + tr("Other input mapping (horns, credit, test, debug)", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
-            std::cout << "   - " << tr("Map joystick buttons to special functions like the big horn pedal (Enter), small horn pedal (Space), credit (coin), test menu (RightShift), and debug mission select (LeftShift).", cfg.language) << "\n\n";
-            print_colored("8. " + tr("Language", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
-            std::cout << "   - " << tr("Change the language used for all menus and messages.", cfg.language) << "\n\n";
-            if (mode == 2) {
-                print_colored("9. " + tr("Set lever-to-key mapping (mode 2)", cfg.language) + "\n", COLOR_PROMPT);
-                std::cout << "   - " << tr("Assign a keyboard key to each lever position (for mode 2).", cfg.language) << "\n\n";
+        } else if (opt == 8) {
+            // Other input mapping sub-menu
+            while (true) {
+                print_colored("\n--- " + tr("Other Input Mapping", cfg.language) + " ---\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
+                print_colored("1. " + tr("Big Horn Pedal", cfg.language) + "\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
+                print_colored("2. " + tr("Small Horn Pedal", cfg.language) + "\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+                print_colored("3. " + tr("Credit", cfg.language) + "\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+                print_colored("4. " + tr("Test Menu", cfg.language) + "\n", FOREGROUND_PINK | FOREGROUND_INTENSITY);
+                print_colored("5. " + tr("Debug Mission Select", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+                print_colored("6. " + tr("Clear all mappings", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+                print_colored("q. " + tr("Return to settings", cfg.language) + "\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+                std::cout << tr("Current:", cfg.language) << " " << tr("Big Horn", cfg.language) << ": ";
+                if (cfg.big_horn_button == -1) std::cout << tr("(not set)", cfg.language); else std::cout << format_input_ref(cfg.big_horn_button, DEVICE_BUTTON_STRIDE);
+                std::cout << ", " << tr("Small Horn", cfg.language) << ": ";
+                if (cfg.small_horn_button == -1) std::cout << tr("(not set)", cfg.language); else std::cout << format_input_ref(cfg.small_horn_button, DEVICE_BUTTON_STRIDE);
+                std::cout << ", " << tr("Credit", cfg.language) << ": ";
+                if (cfg.credit_button == -1) std::cout << tr("(not set)", cfg.language); else std::cout << format_input_ref(cfg.credit_button, DEVICE_BUTTON_STRIDE);
+                std::cout << ", " << tr("Test", cfg.language) << ": ";
+                if (cfg.test_menu_button == -1) std::cout << tr("(not set)", cfg.language); else std::cout << format_input_ref(cfg.test_menu_button, DEVICE_BUTTON_STRIDE);
+                std::cout << ", " << tr("Debug", cfg.language) << ": ";
+                if (cfg.debug_mission_button == -1) std::cout << tr("(not set)", cfg.language); else std::cout << format_input_ref(cfg.debug_mission_button, DEVICE_BUTTON_STRIDE);
+                std::cout << std::endl;
+                std::cout << tr("Select option:", cfg.language) << " ";
+                std::string other_input;
+                std::getline(std::cin, other_input);
+                if (other_input == "q" || other_input == "Q") break;
+                int* mapping_ptr = nullptr;
+                std::string map_label;
+                WORD color = FOREGROUND_YELLOW | FOREGROUND_INTENSITY;
+                if (other_input == "1") { mapping_ptr = &cfg.big_horn_button; map_label = tr("big horn pedal", cfg.language); color = FOREGROUND_YELLOW | FOREGROUND_INTENSITY; }
+                else if (other_input == "2") { mapping_ptr = &cfg.small_horn_button; map_label = tr("small horn pedal", cfg.language); color = FOREGROUND_GREEN | FOREGROUND_INTENSITY; }
+                else if (other_input == "3") { mapping_ptr = &cfg.credit_button; map_label = tr("credit", cfg.language); color = FOREGROUND_GREEN | FOREGROUND_INTENSITY; }
+                else if (other_input == "4") { mapping_ptr = &cfg.test_menu_button; map_label = tr("test menu (RightShift)", cfg.language); color = FOREGROUND_PINK | FOREGROUND_INTENSITY; }
+                else if (other_input == "5") { mapping_ptr = &cfg.debug_mission_button; map_label = tr("debug mission select (LeftShift)", cfg.language); color = FOREGROUND_RED | FOREGROUND_INTENSITY; }
+                if (mapping_ptr) {
+                    print_colored(("\n" + tr("Map ", cfg.language) + map_label + ": " + tr("Press the joystick button you want to use, or press Backspace to clear.", cfg.language) + "\n").c_str(), color);
+                    SDL_Joystick* joy = SDL_JoystickOpen(selected_id);
+                    if (!joy) {
+                        print_colored(tr("Failed to open joystick.", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+                        continue;
+                    }
+                    int mapped = -1;
+                    // Capture currently pressed buttons at the start
+                    ButtonMask initially_pressed = read_snapshot(joy).buttons;
+                    int num_buttons = SDL_JoystickNumButtons(joy);
+                    console().set_raw(true);
+                    while (true) {
+                        if (console().kbhit()) {
+                            int key = console().getch();
+                            if (key == KEY_CODE_BACKSPACE) { mapped = -1; break; }
+                        }
+                        InputSnapshot snap = read_snapshot(joy);
+                        for (int b = 0; b < num_buttons; ++b) {
+                            if (snap.buttons.test(b) && !initially_pressed.test(b)) {
+                                mapped = b;
+                                break;
+                            }
+                        }
+                        if (mapped != -1) break;
+                        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                    }
+                    console().set_raw(false);
+                    SDL_JoystickClose(joy);
+                    *mapping_ptr = mapped;
+                    if (mapped == -1) print_colored((map_label + " " + tr("mapping cleared.", cfg.language) + "\n").c_str(), color);
+                    else {
+                        print_colored((map_label + " " + tr("mapped to button ", cfg.language)).c_str(), color);
+                        std::cout << mapped << std::endl;
+                    }
+                    save_config(cfg, get_profile_filename());
+                } else if (other_input == "6") {
+                    cfg.big_horn_button = -1;
+                    cfg.small_horn_button = -1;
+                    cfg.credit_button = -1;
+                    cfg.test_menu_button = -1;
+                    cfg.debug_mission_button = -1;
+                    print_colored(tr("All input mappings cleared.", cfg.language) + "\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
+                    save_config(cfg, get_profile_filename());
+                } else {
+                    print_colored(tr("Invalid option.", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+                }
             }
-            print_colored(tr("Adjust these settings to balance responsiveness and reliability for your setup.", cfg.language) + "\n", FOREGROUND_LIME | FOREGROUND_INTENSITY);
-            print_colored("---------------------\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
             continue;
-        }
-        // Only parse as integer if input is all digits (after trimming)
-        bool is_number = !trimmed.empty() && std::all_of(trimmed.begin(), trimmed.end(), ::isdigit);
-        int opt = 0;
-        if (is_number) {
-            try { opt = std::stoi(trimmed); } catch (...) { opt = 0; }
-        } else {
-            print_colored(tr("Invalid input! Please enter a number, 'r', 'h', or 'q'.", cfg.language) + "\n\n", COLOR_ERROR);
+        } else if (opt == 9) {
+            std::string new_lang = select_language(cfg.language);
+            cfg.language = new_lang;
+            save_config(cfg, get_profile_filename());
+            load_translations(cfg.language); // reload translations
+            print_colored(tr("Language changed!", cfg.language) + "\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
+            // Update header after language change
+            clear_screen();
+            print_colored("=================================\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            print_colored(tr(TR_KEY("Mascon Lever Input Translator"), cfg.language) + "\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            print_colored("=================================\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            std::cout << tr(TR_KEY("Using joystick #"), cfg.language);
+            print_colored(std::to_string(selected_id), FOREGROUND_PINK | FOREGROUND_INTENSITY);
+            std::cout << ": ";
+            std::cout << SDL_JoystickNameForIndex(selected_id);
+            std::cout << std::endl;
+            std::cout << tr(TR_KEY("Output mode: "), cfg.language);
+            print_colored((mode == 0 ? tr(TR_KEY("Up/Down Arrow Keys"), cfg.language) : tr(TR_KEY("Mouse Scroll"), cfg.language)), FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
+            std::cout << ": ";
+            std::cout << SDL_JoystickNameForIndex(selected_id);
+            std::cout << std::endl;
+            std::cout << tr(TR_KEY("Output mode: "), cfg.language);
+            print_colored((mode == 0 ? tr(TR_KEY("Up/Down Arrow Keys"), cfg.language) : tr(TR_KEY("Mouse Scroll"), cfg.language)), FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
+            std::cout << std::endl;
+            std::cout << "---------------------------------\n";
+            std::cout << tr(TR_KEY("Press "), cfg.language);
+            print_colored(tr(TR_KEY("Tab"), cfg.language), FOREGROUND_LIME);
+            std::cout << tr(TR_KEY(" to open settings menu."), cfg.language) << std::endl;
+            std::cout << tr(TR_KEY("Press "), cfg.language);
+            print_colored(tr(TR_KEY("Esc"), cfg.language), FOREGROUND_RED | FOREGROUND_INTENSITY);
+            std::cout << tr(TR_KEY(" to exit."), cfg.language) << std::endl;
+            std::cout << "---------------------------------\n";
             continue;
-        }
-        if (opt == 1) {
-            print_colored("Enter new debounce ms (current: ", FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-            std::cout << cfg.debounce_ms << "): ";
+        } else if (opt == 12) {
+            print_colored(tr("Enable burst mode? (y/n): ", cfg.language), COLOR_PROMPT);
+            std::getline(std::cin, input);
+            if (input == "y" || input == "Y") cfg.burst_mode = true;
+            else if (input == "n" || input == "N") cfg.burst_mode = false;
+            if (cfg.burst_mode) {
+                print_colored(tr("Minimum spacing between burst events ms, 0 = send as one batch (current: ", cfg.language), COLOR_PROMPT);
+                std::cout << cfg.burst_spacing_ms << "): ";
+                std::getline(std::cin, input);
+                if (!input.empty()) {
+                    try {
+                        cfg.burst_spacing_ms = std::max(0, std::stoi(input));
+                    } catch (...) {
+                        print_colored(tr("Invalid input! Please enter a valid integer.", cfg.language) + "\n\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+                    }
+                }
+            }
+            save_config(cfg, get_profile_filename());
+        } else if (opt == 14) {
+            // Analog lever: pick the axis, then record the value at each notch
+            static const std::vector<std::string> lever_names = {
+                "B9", "B8", "B7", "B6", "B5", "B4", "B3", "B2", "B1", "Neutral",
+                "P1", "P2", "P3", "P4", "P5"
+            };
+            print_colored("\n" + tr("Enter the lever axis number, -1 if your lever uses buttons, or press Enter to detect it: ", cfg.language), COLOR_PROMPT);
+            std::getline(std::cin, input);
+            if (input == "-1") {
+                cfg.lever_axis = -1;
+                save_config(cfg, get_profile_filename());
+                continue;
+            }
+            SDL_Joystick* joy = SDL_JoystickOpen(selected_id);
+            if (!joy) {
+                print_colored(tr("Failed to open joystick for remapping.", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+                continue;
+            }
+            int num_axes = std::min(SDL_JoystickNumAxes(joy), DEVICE_AXIS_STRIDE);
+            int axis = -1;
+            if (input.empty()) {
+                // The lever is the axis that moves the most
+                print_colored(tr("Move the lever through its whole range, then press Enter...", cfg.language) + " ", FOREGROUND_LIME);
+                std::cout.flush();
+                AxisValues lo, hi;
+                lo.fill(INT16_MAX);
+                hi.fill(INT16_MIN);
+                wait_for_enter_or_backspace([&] {
+                    InputSnapshot snap = read_snapshot(joy);
+                    for (int a = 0; a < num_axes; ++a) {
+                        lo[a] = std::min(lo[a], snap.axes[a]);
+                        hi[a] = std::max(hi[a], snap.axes[a]);
+                    }
+                });
+                int best_range = AXIS_DETECT_MIN_RANGE;
+                for (int a = 0; a < num_axes; ++a) {
+                    if (hi[a] - lo[a] >= best_range) {
+                        axis = a;
+                        best_range = hi[a] - lo[a];
+                    }
+                }
+            } else {
+                try { axis = std::stoi(input); } catch (...) { axis = -1; }
+                if (axis >= num_axes) axis = -1;
+            }
+            if (axis < 0) {
+                print_colored("\n" + tr("No lever axis found.", cfg.language) + "\n", COLOR_ERROR);
+                SDL_JoystickClose(joy);
+                continue;
+            }
+            print_colored("\n" + tr("Using axis ", cfg.language) + std::to_string(axis) + "\n", COLOR_INFO);
+            print_colored(tr("Move the lever to each position as prompted, then press Enter.", cfg.language) + "\n", FOREGROUND_LIME);
+            print_colored("Press Backspace to go back to the previous position.\n", FOREGROUND_ORANGE);
+            std::vector<int> notches;
+            int i = 0;
+            while (i < (int)lever_names.size()) {
+                print_colored("Position ", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
+                print_colored(lever_names[i], FOREGROUND_PINK | FOREGROUND_INTENSITY);
+                std::cout << ": Move lever, then press Enter... (Backspace to go back) ";
+                std::cout.flush();
+                if (wait_for_enter_or_backspace() == KEY_CODE_BACKSPACE) {
+                    if (i > 0) {
+                        notches.pop_back();
+                        --i;
+                        print_colored("\nWent back to previous position.\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
+                    } else {
+                        print_colored("\nAlready at the first position.\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+                    }
+                    continue;
+                }
+                print_colored("\n  " + tr("Sampling, hold the lever still...", cfg.language), COLOR_INFO);
+                std::cout.flush();
+                int value = sample_axis_median(joy, axis);
+                notches.push_back(value);
+                print_colored("\n  " + tr("Recorded axis value: ", cfg.language), FOREGROUND_LIME);
+                std::cout << value << std::endl;
+                ++i;
+            }
+            SDL_JoystickClose(joy);
+            if (!notches_ordered(notches)) {
+                print_colored(tr("Notch values overlap or are out of order; calibration discarded. Please try again.", cfg.language) + "\n", COLOR_ERROR);
+                continue;
+            }
+            cfg.lever_axis = axis;
+            cfg.axis_notches = notches;
+            print_colored(tr("Hysteresis (axis units, current: ", cfg.language), COLOR_PROMPT);
+            std::cout << cfg.axis_hysteresis << "): ";
             std::getline(std::cin, input);
             if (!input.empty()) {
-                try {
-                    cfg.debounce_ms = std::max(1, std::stoi(input));
-                    save_config(cfg, get_profile_filename());
-                } catch (...) {
-                    print_colored(tr("Invalid input! Please enter a valid integer.", cfg.language) + "\n\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
-                }
+                try { cfg.axis_hysteresis = std::max(0, std::stoi(input)); } catch (...) {}
             }
-        } else if (opt == 0) {
-            // Profile menu
-            while (true) {
-                system("cls"); // Clear screen at the start of each profile menu loop
-                // List all available profiles
-                std::vector<std::string> profiles;
-                WIN32_FIND_DATAA findFileData;
-                HANDLE hFind = FindFirstFileA("*.cfg", &findFileData);
-                if (hFind != INVALID_HANDLE_VALUE) {
-                    do {
-                        std::string fname = findFileData.cFileName;
-                        if (fname.size() > 4 && fname.substr(fname.size() - 4) == ".cfg") {
-                            profiles.push_back(fname.substr(0, fname.size() - 4));
-                        }
-                    } while (FindNextFileA(hFind, &findFileData));
-                    FindClose(hFind);
-                }
-                std::sort(profiles.begin(), profiles.end());
-                // Always show "Default" as the first profile, and display as "Default" (not mascon_translator)
-                // Remove "mascon_translator" if present, and ensure "Default" is present and first
-                auto it = std::find(profiles.begin(), profiles.end(), "mascon_translator");
-                if (it != profiles.end()) profiles.erase(it);
-                if (std::find(profiles.begin(), profiles.end(), "Default") == profiles.end()) {
-                    profiles.insert(profiles.begin(), "Default");
-                } else {
-                    // Move Default to the front if not already
-                    auto def_it = std::find(profiles.begin(), profiles.end(), "Default");
-                    if (def_it != profiles.begin()) {
-                        profiles.erase(def_it);
-                        profiles.insert(profiles.begin(), "Default");
-                    }
+            print_colored(tr("Dead zone between notches (axis units, current: ", cfg.language), COLOR_PROMPT);
+            std::cout << cfg.axis_deadzone << "): ";
+            std::getline(std::cin, input);
+            if (!input.empty()) {
+                try { cfg.axis_deadzone = std::max(0, std::stoi(input)); } catch (...) {}
+            }
+            save_config(cfg, get_profile_filename());
+            print_colored(tr("Calibration complete!", cfg.language) + "\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            continue;
+        } else if (opt == 15) {
+            // Devices 1, 2, ... merged with the mascon, remembered by GUID
+            print_colored(tr("Available joysticks:", cfg.language) + "\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
+            for (int i = 0; i < SDL_NumJoysticks(); ++i) {
+                print_colored(std::to_string(i), FOREGROUND_PINK | FOREGROUND_INTENSITY);
+                std::cout << ": " << SDL_JoystickNameForIndex(i) << (i == selected_id ? " (" + tr("mascon", cfg.language) + ")" : "") << std::endl;
+            }
+            print_colored(tr("Enter up to 3 joystick numbers for devices 1, 2 and 3, '-' for none, or press Enter to keep them: ", cfg.language), COLOR_PROMPT);
+            std::getline(std::cin, input);
+            if (input == "-") {
+                cfg.extra_joysticks.clear();
+            } else if (!input.empty()) {
+                std::vector<std::string> guids;
+                bool valid = true;
+                for (const std::string& word : split_words(input)) {
+                    int index;
+                    if (!parse_int(word, index) || index < 0 || index >= SDL_NumJoysticks() || index == selected_id || (int)guids.size() == MAX_DEVICES - 1) valid = false;
+                    else guids.push_back(joystick_guid(index));
                 }
-                int current_idx = -1;
-                for (size_t i = 0; i < profiles.size(); ++i) {
-                    if (profiles[i] == cfg.profile) current_idx = (int)i;
+                if (!valid) {
+                    print_colored(tr("Invalid joystick number.", cfg.language) + "\n\n", COLOR_ERROR);
+                    continue;
                 }
-                print_colored("\n", FOREGROUND_CYAN);
-                print_colored("==============================\n", FOREGROUND_LIME | FOREGROUND_INTENSITY);
-                print_colored("   ", FOREGROUND_LIME | FOREGROUND_INTENSITY);
-                print_colored(tr("Profile", cfg.language), FOREGROUND_PINK | FOREGROUND_INTENSITY);
-                print_colored(" ", FOREGROUND_PINK | FOREGROUND_INTENSITY);
-                print_colored("Menu\n", FOREGROUND_PINK | FOREGROUND_INTENSITY);
-                print_colored("==============================\n", FOREGROUND_LIME | FOREGROUND_INTENSITY);
-                print_colored(tr("Available profiles:", cfg.language) + "\n", FOREGROUND_CYAN);
-                for (size_t i = 0; i < profiles.size(); ++i) {
-                    WORD color = (i % 2 == 0) ? FOREGROUND_LIME | FOREGROUND_INTENSITY : FOREGROUND_PINK | FOREGROUND_INTENSITY;
-                    if ((int)i == current_idx) {
-                        print_colored("* ", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
-                    } else {
-                        print_colored("  ", COLOR_DEFAULT);
+                cfg.extra_joysticks.clear();
+                for (const std::string& guid : guids) cfg.extra_joysticks += (cfg.extra_joysticks.empty() ? "" : " ") + guid;
+            }
+            save_config(cfg, get_profile_filename());
+        } else if (opt == 13) {
+            print_colored(tr("Enable lever glitch filter? (y/n): ", cfg.language), COLOR_PROMPT);
+            std::getline(std::cin, input);
+            if (input == "y" || input == "Y") cfg.lever_filter = true;
+            else if (input == "n" || input == "N") cfg.lever_filter = false;
+            if (cfg.lever_filter) {
+                // Helper to read one positive filter setting, keeping the old value on Enter
+                auto ask = [&cfg, &input](const std::string& prompt, int& value) {
+                    print_colored(tr(prompt, cfg.language) + " (" + tr("current: ", cfg.language), COLOR_PROMPT);
+                    std::cout << value << "): ";
+                    std::getline(std::cin, input);
+                    if (input.empty()) return;
+                    try {
+                        value = std::max(1, std::stoi(input));
+                    } catch (...) {
+                        print_colored(tr("Invalid input! Please enter a valid integer.", cfg.language) + "\n\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
                     }
-                    print_colored(std::to_string(i + 1) + ". ", color);
-                    print_colored(profiles[i] + "\n", (profiles[i] == "Default") ? FOREGROUND_CYAN | FOREGROUND_INTENSITY : color);
+                };
+                ask("Identical samples needed to move toward power", cfg.filter_power_samples);
+                ask("Identical samples needed to move toward brake", cfg.filter_brake_samples);
+                ask("Largest normal jump between samples (notches)", cfg.filter_max_jump);
+                ask("Identical samples needed to accept a larger jump", cfg.filter_jump_samples);
+            }
+            save_config(cfg, get_profile_filename());
+        } else if (opt == 11) {
+            // Latency statistics view
+            while (true) {
+                print_colored("\n--- " + tr("Latency statistics", cfg.language) + " ---\n", FOREGROUND_CYAN | FOREGROUND_INTENSITY);
+                std::string report = format_latency_report();
+                std::cout << report;
+                if (latency_stats.hist[LAT_ARROW][LAT_TOTAL].count() + latency_stats.hist[LAT_SCROLL][LAT_TOTAL].count() +
+                    latency_stats.hist[LAT_LEVER_KEY][LAT_TOTAL].count() + latency_stats.hist[LAT_SPECIAL][LAT_TOTAL].count() == 0) {
+                    print_colored(tr("No input measured yet.", cfg.language) + "\n", COLOR_INFO);
                 }
-                print_colored("\n", FOREGROUND_CYAN);
-                print_colored(tr("Enter profile number to switch, 'n' for new, 'd' to delete, 'c' to copy/duplicate, 'r' to rename, or 'q' to cancel:", cfg.language), FOREGROUND_LIME | FOREGROUND_INTENSITY);
-                std::string profile_input;
-                std::getline(std::cin, profile_input);
-                if (profile_input == "q" || profile_input == "Q" || profile_input.empty()) { system("cls"); break; }
-                // Switch profile by number
-                bool is_number = !profile_input.empty() && std::all_of(profile_input.begin(), profile_input.end(), ::isdigit);
-                if (is_number) {
-                    int idx = std::stoi(profile_input) - 1;
-                    if (idx >= 0 && idx < (int)profiles.size()) {
-                        if (profiles[idx] == cfg.profile) {
-                            system("cls");
-                            print_colored(tr("Already using this profile.", cfg.language) + "\n", COLOR_INFO);
-                        } else {
-                            system("cls");
-                            Config new_cfg;
-                            // Fix: If profile is Default, load from mascon_translator.cfg
-                            std::string load_file = (profiles[idx] == "Default") ? "mascon_translator.cfg" : (profiles[idx] + ".cfg");
-                            if (load_config(new_cfg, load_file)) {
-                                cfg = new_cfg;
-                                if (profiles[idx] == "Default") {
-                                    cfg.profile = "Default";
-                                }
-                                print_colored(tr("Profile switched!", cfg.language) + "\n", COLOR_SUCCESS);
-                                // Do NOT save_config here! Only save after user changes settings.
-                            } else {
-                                print_colored(tr("Failed to load profile.", cfg.language) + "\n", COLOR_ERROR);
-                            }
-                        }
-                        continue;
+                std::cout << tr("Enter 'd' to save to latency_stats.txt, 'c' to clear, or 'q' to return: ", cfg.language);
+                std::string stats_input;
+                std::getline(std::cin, stats_input);
+                if (stats_input == "d" || stats_input == "D") {
+                    std::ofstream ofs("latency_stats.txt");
+                    if (ofs) {
+                        ofs << "# Mascon Lever Input Translator latency report (profile: " << cfg.profile << ", debounce_ms=" << cfg.debounce_ms
+                            << ", up_down_delay_ms=" << cfg.up_down_delay_ms << ", mouse_scroll_delay_ms=" << cfg.mouse_scroll_delay_ms
+                            << ", key_hold_time_ms=" << cfg.key_hold_time_ms << ")\n";
+                        ofs << report;
+                        print_colored(tr("Saved to latency_stats.txt", cfg.language) + "\n", COLOR_SUCCESS);
                     } else {
-                        system("cls");
-                        print_colored(tr("Invalid profile number.", cfg.language) + "\n", COLOR_ERROR);
-                        continue;
+                        print_colored(tr("Failed to write latency_stats.txt", cfg.language) + "\n", COLOR_ERROR);
                     }
+                } else if (stats_input == "c" || stats_input == "C") {
+                    latency_stats.reset();
+                    print_colored(tr("Latency statistics cleared.", cfg.language) + "\n", COLOR_INFO);
+                } else if (stats_input.empty() || stats_input == "q" || stats_input == "Q") {
+                    break;
                 }
-                if (profile_input == "c" || profile_input == "C") {
-                    system("cls");
-                    // Duplicate current profile with a suffix
-                    std::string base = cfg.profile;
-                    std::string new_profile = base + "_copy";
-                    int copy_idx = 2;
-                    while (std::find(profiles.begin(), profiles.end(), new_profile) != profiles.end()) {
-                        new_profile = base + "_copy" + std::to_string(copy_idx++);
-                    }
-                    Config new_cfg = cfg;
-                    new_cfg.profile = new_profile;
-                    save_config(new_cfg, new_profile + ".cfg");
-                    print_colored(tr("Profile duplicated!", cfg.language) + "\n", COLOR_SUCCESS);
-                    cfg.profile = new_profile;
-                    save_config(cfg, new_profile + ".cfg");
-                    continue;
-                } else if (profile_input == "n" || profile_input == "N") {
-                    system("cls");
-                    print_colored(tr("Enter new profile name:", cfg.language), COLOR_PROMPT);
-                    std::string new_profile_name;
-                    std::getline(std::cin, new_profile_name);
-                    // Trim whitespace
-                    new_profile_name.erase(0, new_profile_name.find_first_not_of(" \t"));
-                    new_profile_name.erase(new_profile_name.find_last_not_of(" \t") + 1);
-                    if (new_profile_name.empty() || std::find(profiles.begin(), profiles.end(), new_profile_name) != profiles.end()) {
-                        print_colored(tr("Invalid or duplicate profile name.", cfg.language) + "\n", COLOR_ERROR);
-                        continue;
-                    }
-                    Config new_cfg = cfg;
-                    new_cfg.profile = new_profile_name;
-                    save_config(new_cfg, new_profile_name + ".cfg");
-                    print_colored(tr("New profile created!", cfg.language) + "\n", COLOR_SUCCESS);
-                    cfg.profile = new_profile_name;
-                    save_config(cfg, new_profile_name + ".cfg");
-                    continue;
-                } else if (profile_input == "r" || profile_input == "R") {
-                    system("cls");
-                    print_colored(tr("Enter new profile name:", cfg.language), COLOR_PROMPT);
-                    std::string new_name;
-                    std::getline(std::cin, new_name);
-                    // Trim whitespace
-                    new_name.erase(0, new_name.find_first_not_of(" \t"));
-                    new_name.erase(new_name.find_last_not_of(" \t") + 1);
-                    if (new_name.empty() || new_name == cfg.profile || std::find(profiles.begin(), profiles.end(), new_name) != profiles.end()) {
-                        print_colored(tr("Invalid or duplicate profile name.", cfg.language) + "\n", COLOR_ERROR);
-                        continue;
-                    }
-                    // Rename: save config under new name, delete old file
-                    Config renamed_cfg = cfg;
-                    renamed_cfg.profile = new_name;
-                    save_config(renamed_cfg, new_name + ".cfg");
-                    std::string old_file = (cfg.profile == "Default") ? "mascon_translator.cfg" : (cfg.profile + ".cfg");
-                    std::remove(old_file.c_str());
-                    print_colored(tr("Profile renamed!", cfg.language) + "\n", COLOR_SUCCESS);
-                    cfg.profile = new_name;
-                    save_config(cfg, new_name + ".cfg");
-                    continue;
-                } else if (profile_input == "d" || profile_input == "D") {
-                    system("cls");
-                    if (cfg.profile == "Default") {
-                        print_colored(tr("Cannot delete the default profile.", cfg.language) + "\n", COLOR_ERROR);
-                        continue;
-                    }
-                    print_colored(tr("Are you sure you want to delete this profile? Type 'yes' to confirm:", cfg.language), COLOR_WARNING);
-                    std::string confirm;
-                    std::getline(std::cin, confirm);
-                    if (confirm != "yes") {
-                        print_colored(tr("Profile deletion cancelled.", cfg.language) + "\n", COLOR_INFO);
-                        continue;
-                    }
-                    std::string profile_cfg_file = (cfg.profile == "Default") ? "mascon_translator.cfg" : (cfg.profile + ".cfg");
-                    if (std::remove(profile_cfg_file.c_str()) == 0) {
-                        print_colored(tr("Profile deleted!", cfg.language) + "\n", COLOR_SUCCESS);
-                        // Switch to Default profile after deletion
-                        auto it = std::find(profiles.begin(), profiles.end(), "Default");
-                        if (it != profiles.end()) {
-                            Config def_cfg;
-                            if (load_config(def_cfg, "mascon_translator.cfg")) {
-                                cfg = def_cfg;
-                                print_colored(tr("Switched to Default profile.", cfg.language) + "\n", COLOR_INFO);
-                                save_config(cfg, "mascon_translator.cfg");
+            }
+            continue;
+        } else if (opt == 10 && mode == 2) { // Only allow option 9 if mode 2
+            // Set lever-to-key mapping (mode 2)
+            static const std::vector<std::string> lever_names = {
+                "B9", "B8", "B7", "B6", "B5", "B4", "B3", "B2", "B1", "Neutral",
+                "P1", "P2", "P3", "P4", "P5"
+            };
+            print_colored("\n" + tr("Set a key for each lever position. Enter a single character (e.g. a, 1, space), or a Windows virtual-key code (e.g. 0x41 for 'A', 0x31 for '1', 0x25 for Left Arrow, etc). Enter 0 for none.", cfg.language) + "\n", COLOR_PROMPT);
+            for (int i = 0; i < 15; ++i) {
+                std::cout << lever_names[i] << " (current: 0x" << std::hex << cfg.lever_keycodes[i] << std::dec << "): ";
+                std::string key_input;
+                std::getline(std::cin, key_input);
+                if (!key_input.empty()) {
+                    try {
+                        // Trim whitespace
+                        key_input.erase(0, key_input.find_first_not_of(" \t"));
+                        key_input.erase(key_input.find_last_not_of(" \t") + 1);
+                        if (key_input == "0") {
+                            cfg.lever_keycodes[i] = 0;
+                        } else if (key_input.length() == 1) {
+                            // Single character: convert to virtual-key code
+                            char ch = key_input[0];
+                            int vk = vk_from_char(ch);
+                            if (vk != -1) {
+                                cfg.lever_keycodes[i] = vk;
                             } else {
-                                print_colored(tr("Failed to load Default profile.", cfg.language) + "\n", COLOR_ERROR);
+                                print_colored(tr("Unrecognized character. Please enter a valid key or code.\n", cfg.language), COLOR_ERROR);
                             }
+                        } else if (key_input.length() > 1 && (key_input[0] == '0' && (key_input[1] == 'x' || key_input[1] == 'X'))) {
+                            cfg.lever_keycodes[i] = std::stoi(key_input, nullptr, 16);
                         } else {
-                            cfg = default_config;
-                            cfg.profile = "Default";
-                            save_config(cfg, "mascon_translator.cfg");
-                            print_colored(tr("Default profile recreated.", cfg.language) + "\n", COLOR_INFO);
+                            cfg.lever_keycodes[i] = std::stoi(key_input, nullptr, 0);
                         }
-                        continue;
-                    } else {
-                        print_colored(tr("Failed to delete profile file.", cfg.language) + "\n", COLOR_ERROR);
-                        continue;
+                    } catch (...) {
+                        print_colored(tr("Invalid input! Please enter a valid key or code.\n", cfg.language), COLOR_ERROR);
                     }
-                } else {
-                    system("cls");
-                    print_colored(tr("Invalid option.", cfg.language) + "\n", COLOR_ERROR);
-                    continue;
                 }
             }
-        } else if (opt == 2) {
-            print_colored("Enter new up/down delay ms (current: ", FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-            std::cout << cfg.up_down_delay_ms << "): ";
-            std::getline(std::cin, input);
-            if (!input.empty()) {
-                try {
-                    cfg.up_down_delay_ms = std::max(1, std::stoi(input));
-                    save_config(cfg, get_profile_filename());
-                } catch (...) {
-                    print_colored(tr("Invalid input! Please enter a valid integer.", cfg.language) + "\n\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
-                }
+            save_config(cfg, get_profile_filename());
+            print_colored(tr("Lever-to-key mapping updated!", cfg.language) + "\n", COLOR_SUCCESS);
+            continue;
+        } else {
+            print_colored("Invalid option.\n\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+        }
+        cfg.last_mode = mode;
+        cfg.last_joystick = selected_id;
+        save_config(cfg, get_profile_filename());
+    }
+}
+
+// Output timing for the credit and lever-to-key (mode 2) key presses
+const int CREDIT_HOLD_MS = 10;
+const int CREDIT_REPEAT_MS = 50;
+const int LEVER_KEY_HOLD_MS = 10;
+const int LEVER_KEY_REPEAT_MS = 210;
+
+// Lever/horn/credit translation state, driven by the input thread.
+// The main thread only touches it while the input thread is paused.
+// Settings with everything derived from them already built, so the input
+// thread can switch to a new profile by moving these in
+struct PreparedConfig {
+    Config config;
+    LeverDecoder lever_decoder;
+    AxisQuantiser lever_quantiser;
+};
+
+PreparedConfig prepare_config(const Config& cfg) {
+    PreparedConfig prepared;
+    prepared.config = cfg;
+    prepared.lever_decoder.build(cfg.lever_mappings);
+    prepared.lever_quantiser.build(cfg.axis_notches, cfg.axis_hysteresis, cfg.axis_deadzone);
+    return prepared;
+}
+
+// What the input thread logs once a posted config has taken effect
+enum class ReloadNotice : uint8_t { None, FileChanged, ProfileSwitched };
+
+struct Translator {
+    Config config;
+    int mode = 0;
+    std::string lang;
+    LeverDecoder lever_decoder;
+    LeverFilter lever_filter;
+    AxisQuantiser lever_quantiser;
+    OutputScheduler* output = nullptr;
+    AsyncLogger* logger = nullptr;
+    int last_idx = -1;
+    int stable_idx = -1;
+    Clock::time_point last_event_time = Clock::now();
+    // When the current lever candidate was first read and decoded (latency stats)
+    Clock::time_point stable_read_time;
+    Clock::time_point stable_decode_time;
+    // For credit repeat
+    Clock::time_point last_credit_time = Clock::now() - std::chrono::milliseconds(250);
+    // For lever-to-key (mode 2) repeat
+    Clock::time_point next_lever_key_time;
+    bool credit_prev_pressed = false;
+    bool big_horn_key_down = false;
+    bool small_horn_key_down = false;
+    bool test_menu_prev_pressed = false;
+    bool debug_mission_prev_pressed = false;
+    uint32_t devices_connected = ~0u;
+    uint32_t lever_devices = 1; // devices the lever mappings or axis refer to
+
+    // Copy settings in and rebuild the decode table (profile may have changed)
+    void load(const Config& cfg, int new_mode, const std::string& new_lang) {
+        mode = new_mode;
+        lang = new_lang;
+        {
+            std::lock_guard<std::mutex> lock(reload_mtx);
+            pending_reload.reset(); // older than what is being loaded now
+            reload_pending = false;
+        }
+        apply(prepare_config(cfg));
+    }
+
+    // Called from another thread: the next tick() switches to these settings.
+    // Mode, language and the lever's current position are kept. 'notice' is
+    // what gets logged once the switch has happened.
+    void post_reload(std::shared_ptr<PreparedConfig> prepared, ReloadNotice notice = ReloadNotice::FileChanged) {
+        std::lock_guard<std::mutex> lock(reload_mtx);
+        pending_reload = std::move(prepared);
+        reload_notice = notice;
+        reload_pending = true;
+    }
+
+    // Analog lever configured and calibrated
+    bool uses_axis() const { return config.lever_axis >= 0 && config.lever_axis < MAX_AXES && lever_quantiser.ready(); }
+
+    // Process the current button state. Returns how many ms until this needs
+    // to run again without new input (debounce/repeat), or -1 if it only
+    // needs to run on the next button change. Never blocks: all output goes
+    // through the scheduler.
+    int tick(const InputSnapshot& snap) {
+        if (reload_pending.load(std::memory_order_acquire)) apply_reload();
+        wake_ms = -1;
+        if (snap.connected != devices_connected) {
+            for (int d = 0; d < MAX_DEVICES; ++d) {
+                uint32_t bit = 1u << d;
+                if ((snap.connected ^ devices_connected) & bit) logger->log((snap.connected & bit) ? LogEvent::DeviceReconnected : LogEvent::DeviceRemoved, d);
             }
-        } else if (opt == 3) {
-            print_colored("Enter new mouse scroll delay ms (current: ", FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-            std::cout << cfg.mouse_scroll_delay_ms << "): ";
-            std::getline(std::cin, input);
-            if (!input.empty()) {
-                try {
-                    cfg.mouse_scroll_delay_ms = std::max(1, std::stoi(input));
-                    save_config(cfg, get_profile_filename());
-                } catch (...) {
-                    print_colored(tr("Invalid input! Please enter a valid integer.", cfg.language) + "\n\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+            devices_connected = snap.connected;
+            // Readings from before the unplug say nothing about where the lever is now
+            lever_filter.configure(config.filter_power_samples, config.filter_brake_samples, config.filter_max_jump, config.filter_jump_samples);
+        }
+        // An unplugged device has nothing pressed, which releases held horns
+        // and shift keys; the lever keeps its last position until all of its
+        // devices are back
+        handle_special_inputs(snap);
+        if ((snap.connected & lever_devices) == lever_devices) handle_lever(snap);
+        return wake_ms;
+    }
+
+    // Horns, credit, test menu and debug mission select
+    void handle_special_inputs(const InputSnapshot& snap) {
+        const Clock::time_point now = snap.timestamp;
+        // No debounce here, so decode and accept are the same moment
+        LatencyStamps stamps;
+        stamps.channel = LAT_SPECIAL;
+        stamps.read = snap.timestamp;
+        stamps.decode = stamps.accept = Clock::now();
+        LatencyStamps release_stamps = stamps; // key-ups are measured too
+        // --- Always process other input buttons, regardless of focus ---
+        bool credit_pressed = snap.buttons.test(config.credit_button);
+        bool big_horn_now = snap.buttons.test(config.big_horn_button);
+        bool small_horn_now = snap.buttons.test(config.small_horn_button);
+        bool test_menu_now = snap.buttons.test(config.test_menu_button);
+        bool debug_mission_now = snap.buttons.test(config.debug_mission_button);
+        // --- Big Horn Pedal (Enter) HOLD logic ---
+        if (big_horn_now && !big_horn_key_down) {
+            output->schedule(now, OutputKind::KeyDown, VK_RETURN, true, stamps);
+            logger->log(LogEvent::BigHornDown);
+            big_horn_key_down = true;
+        } else if (!big_horn_now && big_horn_key_down) {
+            output->schedule(now, OutputKind::KeyUp, VK_RETURN, true, release_stamps);
+            logger->log(LogEvent::BigHornUp);
+            big_horn_key_down = false;
+        }
+        // --- Small Horn Pedal (Space) HOLD logic ---
+        if (small_horn_now && !small_horn_key_down) {
+            output->schedule(now, OutputKind::KeyDown, VK_SPACE, true, stamps);
+            logger->log(LogEvent::SmallHornDown);
+            small_horn_key_down = true;
+        } else if (!small_horn_now && small_horn_key_down) {
+            output->schedule(now, OutputKind::KeyUp, VK_SPACE, true, release_stamps);
+            logger->log(LogEvent::SmallHornUp);
+            small_horn_key_down = false;
+        }
+        // --- Test Menu (Right Shift) logic ---
+        if (test_menu_now && !test_menu_prev_pressed) {
+            output->schedule(now, OutputKind::KeyDown, VK_RSHIFT, true, stamps);
+            logger->log(LogEvent::TestMenuDown);
+        } else if (!test_menu_now && test_menu_prev_pressed) {
+            output->schedule(now, OutputKind::KeyUp, VK_RSHIFT, true, release_stamps);
+            logger->log(LogEvent::TestMenuUp);
+        }
+        test_menu_prev_pressed = test_menu_now;
+        // --- Debug Mission (Left Shift) logic ---
+        if (debug_mission_now && !debug_mission_prev_pressed) {
+            output->schedule(now, OutputKind::KeyDown, VK_LSHIFT, true, stamps);
+            logger->log(LogEvent::DebugMissionDown);
+        } else if (!debug_mission_now && debug_mission_prev_pressed) {
+            output->schedule(now, OutputKind::KeyUp, VK_LSHIFT, true, release_stamps);
+            logger->log(LogEvent::DebugMissionUp);
+        }
+        debug_mission_prev_pressed = debug_mission_now;
+        // Credit repeat logic
+        if (config.credit_button >= 0) {
+            if (credit_pressed) {
+                if (!credit_prev_pressed || std::chrono::duration_cast<std::chrono::milliseconds>(now - last_credit_time).count() >= CREDIT_REPEAT_MS) {
+                    // Send [ key (VK_OEM_4) using scan code
+                    output->schedule(now, OutputKind::KeyDown, VK_OEM_4, true, stamps);
+                    output->schedule(now + std::chrono::milliseconds(CREDIT_HOLD_MS), OutputKind::KeyUp, VK_OEM_4, true);
+                    logger->log(LogEvent::CreditSent);
+                    last_credit_time = now;
+                }
+                credit_prev_pressed = true;
+                // Keep repeating while the credit button is held
+                want_wake(CREDIT_REPEAT_MS - std::chrono::duration_cast<std::chrono::milliseconds>(now - last_credit_time).count());
+            } else {
+                credit_prev_pressed = false;
+            }
+        }
+    }
+
+    // Lever/arrow/mouse logic should always run, regardless of focus
+    void handle_lever(const InputSnapshot& snap) {
+        const Clock::time_point now = snap.timestamp;
+        int idx = uses_axis() ? lever_quantiser.quantise(snap.axes[config.lever_axis]) : lever_decoder.decode(snap.buttons);
+        if (config.lever_filter) {
+            idx = lever_filter.update(idx, now);
+            // Keep sampling until the filter has made up its mind
+            if (lever_filter.pending()) want_wake(lever_filter.next_sample_ms(now));
+        }
+        const Clock::time_point decoded = Clock::now();
+        if (mode == 2) {
+            if (idx >= 0 && idx < 15) {
+                int vk = config.lever_keycodes[idx];
+                if (vk > 0) {
+                    // Key repeats for as long as the lever stays here
+                    if (now >= next_lever_key_time) {
+                        // Send the key as a press and release
+                        LatencyStamps stamps;
+                        stamps.channel = LAT_LEVER_KEY;
+                        stamps.read = snap.timestamp;
+                        stamps.decode = stamps.accept = decoded;
+                        Clock::time_point start = output->reserve_lever(now, std::chrono::milliseconds(LEVER_KEY_REPEAT_MS));
+                        output->schedule(start, OutputKind::KeyDown, vk, false, stamps);
+                        output->schedule(start + std::chrono::milliseconds(LEVER_KEY_HOLD_MS), OutputKind::KeyUp, vk, false);
+                        logger->log(LogEvent::LeverKeySent, vk);
+                        next_lever_key_time = start + std::chrono::milliseconds(LEVER_KEY_REPEAT_MS);
+                    }
+                    want_wake(std::chrono::duration_cast<std::chrono::milliseconds>(next_lever_key_time - now).count());
                 }
             }
-        } else if (opt == 4) {
-            print_colored("Enter new key hold time ms (current: ", FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-            std::cout << cfg.key_hold_time_ms << "): ";
-            std::getline(std::cin, input);
-            if (!input.empty()) {
-                try {
-                    cfg.key_hold_time_ms = std::max(1, std::stoi(input));
-                    save_config(cfg, get_profile_filename());
-                } catch (...) {
-                    print_colored(tr("Invalid input! Please enter a valid integer.", cfg.language) + "\n\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+            return;
+        }
+        if (idx != stable_idx) {
+            stable_idx = idx;
+            last_event_time = now;
+            stable_read_time = lever_read_time(snap);
+            stable_decode_time = decoded;
+        }
+        // Debounce logic: Only config.debounce_ms is used for debounce timing.
+        // up_down_delay_ms and mouse_scroll_delay_ms are NOT used for debounce;
+        // they pace the queued steps in the output scheduler instead.
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_event_time).count();
+        if (idx != -1 && idx != last_idx && elapsed >= config.debounce_ms) {
+            if (last_idx != -1 && config.burst_mode && mode != 2) {
+                send_burst(idx, now);
+            } else if (last_idx != -1) {
+                int diff = idx - last_idx;
+                // Only move one step per debounce period for consistent timing
+                int step = (diff > 0) ? 1 : -1;
+                int next_idx = last_idx + step;
+                LatencyStamps stamps;
+                stamps.read = stable_read_time;
+                stamps.decode = stable_decode_time;
+                stamps.accept = Clock::now();
+                if (mode == 0) {
+                    int key = (step > 0) ? VK_DOWN : VK_UP;
+                    stamps.channel = LAT_ARROW;
+                    Clock::time_point start = output->reserve_lever(now, std::chrono::milliseconds(config.key_hold_time_ms + config.up_down_delay_ms));
+                    output->schedule(start, OutputKind::KeyDown, key, false, stamps);
+                    output->schedule(start + std::chrono::milliseconds(config.key_hold_time_ms), OutputKind::KeyUp, key, false);
+                } else if (mode == 1) {
+                    stamps.channel = LAT_SCROLL;
+                    Clock::time_point start = output->reserve_lever(now, std::chrono::milliseconds(config.mouse_scroll_delay_ms));
+                    output->schedule(start, OutputKind::Scroll, (step > 0) ? -120 : 120, false, stamps);
                 }
+                logger->log(LogEvent::LeverStep, last_idx, next_idx);
+                last_idx = next_idx;
+            } else if (idx == 9) {
+                logger->log(LogEvent::Neutral);
+                last_idx = idx;
             }
-        } else if (opt == 5) {
-            print_colored("Enter new output mode (", COLOR_PROMPT);
-            print_colored("0", COLOR_PROMPT);
-            std::cout << " = Arrow Keys, ";
-            print_colored("1", COLOR_PROMPT);
-            std::cout << " = Mouse Scroll, ";
-            print_colored("2", COLOR_PROMPT);
-            std::cout << " = Lever-to-Key), current: " << mode << ": ";
-            std::getline(std::cin, input);
-            if (!input.empty()) {
-                if (input == "0") mode = 0;
-                else if (input == "1") mode = 1;
-                else if (input == "2") mode = 2;
-                else print_colored(tr("Invalid input! Please enter 0, 1 or 2.", cfg.language) + "\n\n", COLOR_ERROR);
-                save_config(cfg, get_profile_filename());
+            last_event_time = now;
+            elapsed = 0;
+        }
+        // Still away from the target position: come back when the debounce expires
+        if (idx != -1 && idx != last_idx && (last_idx != -1 || idx == 9)) {
+            want_wake(config.debounce_ms - elapsed);
+        }
+    }
+
+    // When the lever's devices last reported a change, so a lever on a
+    // second device is timed from its own input (replays: the tick time)
+    Clock::time_point lever_read_time(const InputSnapshot& snap) const {
+        Clock::time_point latest;
+        for (int d = 0; d < MAX_DEVICES; ++d) {
+            if (lever_devices & (1u << d)) latest = std::max(latest, snap.device_times[d]);
+        }
+        return (latest == Clock::time_point() || latest > snap.timestamp) ? snap.timestamp : latest;
+    }
+
+    // Burst mode: the whole move from last_idx to idx at once, either as one
+    // batch or spaced burst_spacing_ms apart for games that drop events. Arrow
+    // keys are still held key_hold_time_ms each; events falling due together
+    // (one step's release and the next press) go out as one batch.
+    void send_burst(int idx, Clock::time_point now) {
+        int steps = std::abs(idx - last_idx);
+        bool down = idx > last_idx;
+        LatencyStamps stamps;
+        stamps.read = stable_read_time;
+        stamps.decode = stable_decode_time;
+        stamps.accept = Clock::now();
+        stamps.channel = mode == 0 ? LAT_ARROW : LAT_SCROLL;
+        const std::chrono::milliseconds spacing(config.burst_spacing_ms);
+        const std::chrono::milliseconds hold(mode == 0 ? config.key_hold_time_ms : 0);
+        // Offset from the start of the burst of each event, in order
+        std::vector<std::pair<std::chrono::milliseconds, SinkEvent>> timeline;
+        std::chrono::milliseconds t(0);
+        for (int i = 0; i < steps; ++i) {
+            if (mode == 0) {
+                int key = down ? VK_DOWN : VK_UP;
+                timeline.push_back({t, SinkEvent{OutputKind::KeyDown, key, false}});
+                timeline.push_back({t + hold, SinkEvent{OutputKind::KeyUp, key, false}});
+                t += hold + spacing;
+            } else {
+                timeline.push_back({t, SinkEvent{OutputKind::Scroll, down ? -120 : 120, false}});
+                t += spacing;
             }
-        } else if (opt == 6) {
-            print_colored("Available joysticks:\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
-            for (int i = 0; i < num_joysticks; ++i) {
-                print_colored(std::to_string(i), FOREGROUND_PINK | FOREGROUND_INTENSITY);
-                std::cout << ": " << SDL_JoystickNameForIndex(i) << std::endl;
+        }
+        Clock::time_point start = output->reserve_lever(now, t);
+        for (size_t i = 0; i < timeline.size();) {
+            size_t end = i + 1;
+            while (end < timeline.size() && timeline[end].first == timeline[i].first) ++end;
+            LatencyStamps group_stamps = i == 0 ? stamps : LatencyStamps();
+            if (end - i == 1) {
+                const SinkEvent& ev = timeline[i].second;
+                output->schedule(start + timeline[i].first, ev.kind, ev.code, false, group_stamps);
+            } else {
+                std::vector<SinkEvent> batch;
+                for (size_t j = i; j < end; ++j) batch.push_back(timeline[j].second);
+                output->schedule_batch(start + timeline[i].first, batch, group_stamps);
             }
-            print_colored("Enter new joystick number (current: ", FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-            std::cout << selected_id << "): ";
-            std::getline(std::cin, input);
-            if (!input.empty()) {
-                try {
-                    int new_id = std::stoi(input);
-                    if (new_id >= 0 && new_id < num_joysticks) {
-                        selected_id = new_id;
-                        save_config(cfg, get_profile_filename());
-                    } else {
-                        print_colored(tr("Invalid joystick number.", cfg.language) + "\n\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
-                    }
-                } catch (...) {
-                    print_colored(tr("Invalid input! Please enter a valid integer.", cfg.language) + "\n\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+            i = end;
+        }
+        logger->log(LogEvent::LeverStep, last_idx, idx);
+        last_idx = idx;
+    }
+
+private:
+    int wake_ms = -1;
+    std::mutex reload_mtx;
+    std::shared_ptr<PreparedConfig> pending_reload;
+    ReloadNotice reload_notice = ReloadNotice::None;
+    std::atomic<bool> reload_pending{false};
+
+    void apply(PreparedConfig&& prepared) {
+        config = std::move(prepared.config);
+        lever_decoder = std::move(prepared.lever_decoder);
+        lever_quantiser = std::move(prepared.lever_quantiser);
+        lever_filter.configure(config.filter_power_samples, config.filter_brake_samples, config.filter_max_jump, config.filter_jump_samples);
+        lever_devices = 0;
+        if (config.lever_axis >= 0) lever_devices = 1u << (config.lever_axis / DEVICE_AXIS_STRIDE);
+        else {
+            for (const auto& combo : config.lever_mappings) {
+                for (int b : combo) {
+                    if (b >= 0 && b < MAX_BUTTONS) lever_devices |= 1u << (b / DEVICE_BUTTON_STRIDE);
                 }
             }
-        } else if (opt == 7) {
-            // Remap lever positions
-            static const std::vector<std::string> lever_names = {
-                "B9", "B8", "B7", "B6", "B5", "B4", "B3", "B2", "B1", "Neutral",
-                "P1", "P2", "P3", "P4", "P5"
-            };
-            print_colored("\nLever remapping: Move the lever to each position as prompted, then press Enter.\n", FOREGROUND_LIME);
-            print_colored("If you want to skip a position, just press Enter without moving.\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
-            print_colored("Press Backspace to go back to the previous position.\n", FOREGROUND_ORANGE);
-            SDL_Joystick* joy = SDL_JoystickOpen(selected_id);
-            if (!joy) {
-                print_colored(tr("Failed to open joystick for remapping.", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+        }
+    }
+
+    void apply_reload() {
+        std::shared_ptr<PreparedConfig> prepared;
+        ReloadNotice notice;
+        {
+            std::lock_guard<std::mutex> lock(reload_mtx);
+            prepared.swap(pending_reload);
+            notice = reload_notice;
+            reload_pending = false;
+        }
+        if (!prepared) return;
+        apply(std::move(*prepared));
+        if (notice == ReloadNotice::FileChanged) logger->log(LogEvent::ConfigReloaded);
+        else if (notice == ReloadNotice::ProfileSwitched) logger->log(LogEvent::ProfileSwitched, config.profile);
+    }
+
+    void want_wake(long long ms) {
+        int w = (int)std::max(0LL, ms);
+        if (wake_ms < 0 || w < wake_ms) wake_ms = w;
+    }
+};
+
+// How long the input thread sleeps in SDL_WaitEventTimeout when nothing is pending
+const int INPUT_IDLE_WAIT_MS = 250;
+// How often the main thread checks the Tab/Esc hotkeys
+const int HOTKEY_POLL_MS = 15;
+
+// Pause/stop handshake between the main (console) thread and the input thread
+struct InputThreadControl {
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool pause_requested = false;
+    bool paused = false;
+    bool stop_requested = false;
+};
+
+// Input thread: blocks on the input source and only runs the translator
+// when the button state changes or a debounce/repeat deadline is due
+void run_input_thread(Translator& translator, InputSource& source, InputThreadControl& ctl) {
+    source.reseed();
+    int wait_ms = translator.tick(source.snapshot());
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(ctl.mtx);
+            if (ctl.stop_requested) return;
+            if (ctl.pause_requested) {
+                ctl.paused = true;
+                ctl.cv.notify_all();
+                ctl.cv.wait(lock, [&ctl] { return !ctl.pause_requested || ctl.stop_requested; });
+                ctl.paused = false;
+                if (ctl.stop_requested) return;
+                lock.unlock();
+                source.reseed();
+                wait_ms = translator.tick(source.snapshot());
                 continue;
             }
-            std::vector<std::set<int>> new_mappings;
-            int i = 0;
-            while (i < (int)lever_names.size()) {
-                print_colored("Position ", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
-                print_colored(lever_names[i], FOREGROUND_PINK | FOREGROUND_INTENSITY);
-                std::cout << ": Move lever, then press Enter... (Backspace to go back) ";
-                std::cout.flush();
-                // Wait for Enter or Backspace
-                std::string dummy;
-                int key = 0;
-                dummy.clear();
-                while (true) {
-                    if (_kbhit()) {
-                        key = _getch();
-                        if (key == 13) { // Enter
-                            break;
-                        } else if (key == 8) { // Backspace
-                            break;
-                        }
-                    }
-                    std::this_thread::sleep_for(std::chrono::milliseconds(20));
-                }
-                if (key == 8) { // Backspace
-                    if (i > 0) {
-                        new_mappings.pop_back();
-                        --i;
-                        print_colored("\nWent back to previous position.\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
-                    } else {
-                        print_colored("\nAlready at the first position.\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
-                    }
-                    continue;
-                }
-                SDL_JoystickUpdate();
-                std::set<int> pressed;
-                int num_buttons = SDL_JoystickNumButtons(joy);
-                for (int b = 0; b < num_buttons; ++b) {
-                    if (SDL_JoystickGetButton(joy, b)) pressed.insert(b);
-                }
-                new_mappings.push_back(pressed);
-                print_colored("  Recorded buttons: ", FOREGROUND_LIME);
-                if (pressed.empty()) std::cout << "(none)";
-                else for (int b : pressed) std::cout << b << " ";
-                std::cout << std::endl;
-                ++i;
+        }
+        source.wait(wait_ms < 0 ? INPUT_IDLE_WAIT_MS : wait_ms);
+        wait_ms = translator.tick(source.snapshot());
+    }
+}
+
+// Blocks until the input thread has parked itself
+void pause_input_thread(InputThreadControl& ctl, InputSource& source) {
+    std::unique_lock<std::mutex> lock(ctl.mtx);
+    ctl.pause_requested = true;
+    source.wake();
+    ctl.cv.wait(lock, [&ctl] { return ctl.paused; });
+}
+
+void resume_input_thread(InputThreadControl& ctl) {
+    std::lock_guard<std::mutex> lock(ctl.mtx);
+    ctl.pause_requested = false;
+    ctl.cv.notify_all();
+}
+
+void stop_input_thread(InputThreadControl& ctl, InputSource& source, std::thread& thread) {
+    {
+        std::lock_guard<std::mutex> lock(ctl.mtx);
+        ctl.stop_requested = true;
+        ctl.cv.notify_all();
+    }
+    source.wake();
+    if (thread.joinable()) thread.join();
+}
+
+// Helper for case-insensitive wildcard matching (* = any run, ? = any character)
+bool glob_match(std::string_view pattern, std::string_view text) {
+    size_t p = 0, t = 0, star = std::string_view::npos, resume = 0;
+    while (t < text.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || std::tolower((unsigned char)pattern[p]) == std::tolower((unsigned char)text[t]))) {
+            ++p;
+            ++t;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            resume = t;
+        } else if (star != std::string_view::npos) {
+            p = star + 1;
+            t = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') ++p;
+    return p == pattern.size();
+}
+
+// Rules for switching profiles with the focused window, one per line:
+//   exe:BveTs.exe=BVE
+//   title:*Densha de GO*=DDG
+//   class:UnityWndClass=Unity
+// The first rule whose pattern matches wins.
+const char* const PROFILE_RULES_FILE = "profile_rules.txt";
+
+class ProfileRules {
+public:
+    // false if there is no rules file
+    bool load(const std::string& filename) {
+        rules.clear();
+        std::ifstream ifs(filename);
+        if (!ifs) return false;
+        std::string line;
+        while (std::getline(ifs, line)) {
+            std::string_view view = trim_view(line);
+            if (!view.empty() && view.back() == '\r') view = trim_view(view.substr(0, view.size() - 1));
+            if (view.empty() || view[0] == '#') continue;
+            size_t colon = view.find(':');
+            size_t eq = view.rfind('=');
+            if (colon == std::string_view::npos || eq == std::string_view::npos || eq < colon) continue;
+            Rule rule;
+            std::string_view field = trim_view(view.substr(0, colon));
+            if (field == "exe") rule.field = &WindowIdentity::exe;
+            else if (field == "class") rule.field = &WindowIdentity::window_class;
+            else if (field == "title") rule.field = &WindowIdentity::title;
+            else continue;
+            rule.pattern = std::string(trim_view(view.substr(colon + 1, eq - colon - 1)));
+            rule.profile = std::string(trim_view(view.substr(eq + 1)));
+            if (!rule.profile.empty()) rules.push_back(rule);
+        }
+        return true;
+    }
+
+    bool empty() const { return rules.empty(); }
+
+    // Profile for this window, or nullptr if no rule matches
+    const std::string* match(const WindowIdentity& window) const {
+        for (const auto& rule : rules) {
+            if (glob_match(rule.pattern, window.*rule.field)) return &rule.profile;
+        }
+        return nullptr;
+    }
+
+    std::set<std::string> profiles() const {
+        std::set<std::string> names;
+        for (const auto& rule : rules) names.insert(rule.profile);
+        return names;
+    }
+
+private:
+    struct Rule {
+        std::string WindowIdentity::* field;
+        std::string pattern;
+        std::string profile;
+    };
+    std::vector<Rule> rules;
+};
+
+// How often the main loop checks which window has focus
+const int FOREGROUND_POLL_MS = 100;
+
+// Switches the translator to the profile of the focused window. Every
+// profile named in the rules is loaded and prepared up front, so a focus
+// change only hands a ready PreparedConfig to the translator, which takes
+// it on its next tick. Windows no rule matches go back to the profile
+// chosen in the settings menu.
+class ProfileSwitcher {
+public:
+    ProfileSwitcher(Translator& t, InputSource& s) : translator(t), source(s) {}
+
+    // (Re)load the rules and profiles. 'cfg' is the profile now in use: when
+    // it is still the rule-chosen one the manual profile is kept for when the
+    // rule stops matching; otherwise it becomes the manual profile.
+    void reset(const Config& cfg) {
+        if (active.empty() || cfg.profile != active) {
+            manual = cfg;
+            active.clear();
+        }
+        window_known = false;
+        preloaded.clear();
+        rules.load(PROFILE_RULES_FILE);
+        for (const std::string& name : rules.profiles()) {
+            if (const Config* found = profile_index().find(name)) {
+                preloaded[name] = std::make_shared<const PreparedConfig>(prepare_config(*found));
             }
-            SDL_JoystickClose(joy);
-            cfg.lever_mappings = new_mappings;
-            save_config(cfg, get_profile_filename());
-            print_colored("Remapping complete!\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-            continue;
-        } else if (opt == 8) {
-            // Other input mapping sub-menu
-            while (true) {
-                print_colored("\n--- " + tr("Other Input Mapping", cfg.language) + " ---\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
-                print_colored("1. " + tr("Big Horn Pedal", cfg.language) + "\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
-                print_colored("2. " + tr("Small Horn Pedal", cfg.language) + "\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-                print_colored("3. " + tr("Credit", cfg.language) + "\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-                print_colored("4. " + tr("Test Menu", cfg.language) + "\n", FOREGROUND_PINK | FOREGROUND_INTENSITY);
-                print_colored("5. " + tr("Debug Mission Select", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
-                print_colored("6. " + tr("Clear all mappings", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
-                print_colored("q. " + tr("Return to settings", cfg.language) + "\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-                std::cout << tr("Current:", cfg.language) << " " << tr("Big Horn", cfg.language) << ": ";
-                if (cfg.big_horn_button == -1) std::cout << tr("(not set)", cfg.language); else std::cout << cfg.big_horn_button;
-                std::cout << ", " << tr("Small Horn", cfg.language) << ": ";
-                if (cfg.small_horn_button == -1) std::cout << tr("(not set)", cfg.language); else std::cout << cfg.small_horn_button;
-                std::cout << ", " << tr("Credit", cfg.language) << ": ";
-                if (cfg.credit_button == -1) std::cout << tr("(not set)", cfg.language); else std::cout << cfg.credit_button;
-                std::cout << ", " << tr("Test", cfg.language) << ": ";
-                if (cfg.test_menu_button == -1) std::cout << tr("(not set)", cfg.language); else std::cout << cfg.test_menu_button;
-                std::cout << ", " << tr("Debug", cfg.language) << ": ";
-                if (cfg.debug_mission_button == -1) std::cout << tr("(not set)", cfg.language); else std::cout << cfg.debug_mission_button;
-                std::cout << std::endl;
-                std::cout << tr("Select option:", cfg.language) << " ";
-                std::string other_input;
-                std::getline(std::cin, other_input);
-                if (other_input == "q" || other_input == "Q") break;
-                int* mapping_ptr = nullptr;
-                std::string map_label;
-                WORD color = FOREGROUND_YELLOW | FOREGROUND_INTENSITY;
-                if (other_input == "1") { mapping_ptr = &cfg.big_horn_button; map_label = tr("big horn pedal", cfg.language); color = FOREGROUND_YELLOW | FOREGROUND_INTENSITY; }
-                else if (other_input == "2") { mapping_ptr = &cfg.small_horn_button; map_label = tr("small horn pedal", cfg.language); color = FOREGROUND_GREEN | FOREGROUND_INTENSITY; }
-                else if (other_input == "3") { mapping_ptr = &cfg.credit_button; map_label = tr("credit", cfg.language); color = FOREGROUND_GREEN | FOREGROUND_INTENSITY; }
-                else if (other_input == "4") { mapping_ptr = &cfg.test_menu_button; map_label = tr("test menu (RightShift)", cfg.language); color = FOREGROUND_PINK | FOREGROUND_INTENSITY; }
-                else if (other_input == "5") { mapping_ptr = &cfg.debug_mission_button; map_label = tr("debug mission select (LeftShift)", cfg.language); color = FOREGROUND_RED | FOREGROUND_INTENSITY; }
-                if (mapping_ptr) {
-                    print_colored(("\n" + tr("Map ", cfg.language) + map_label + ": " + tr("Press the joystick button you want to use, or press Backspace to clear.", cfg.language) + "\n").c_str(), color);
-                    SDL_Joystick* joy = SDL_JoystickOpen(selected_id);
-                    if (!joy) {
-                        print_colored(tr("Failed to open joystick.", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
-                        continue;
-                    }
-                    int mapped = -1;
-                    // Capture currently pressed buttons at the start
-                    std::set<int> initially_pressed;
-                    SDL_JoystickUpdate();
-                    int num_buttons = SDL_JoystickNumButtons(joy);
-                    for (int b = 0; b < num_buttons; ++b) {
-                        if (SDL_JoystickGetButton(joy, b)) initially_pressed.insert(b);
-                    }
-                    while (true) {
-                        if (_kbhit()) {
-                            int key = _getch();
-                            if (key == 8) { mapped = -1; break; }
-                        }
-                        SDL_JoystickUpdate();
-                        for (int b = 0; b < num_buttons; ++b) {
-                            if (SDL_JoystickGetButton(joy, b) && initially_pressed.find(b) == initially_pressed.end()) {
-                                mapped = b;
-                                break;
-                            }
-                        }
-                        if (mapped != -1) break;
-                        std::this_thread::sleep_for(std::chrono::milliseconds(20));
-                    }
-                    SDL_JoystickClose(joy);
-                    *mapping_ptr = mapped;
-                    if (mapped == -1) print_colored((map_label + " " + tr("mapping cleared.", cfg.language) + "\n").c_str(), color);
-                    else {
-                        print_colored((map_label + " " + tr("mapped to button ", cfg.language)).c_str(), color);
-                        std::cout << mapped << std::endl;
-                    }
-                    save_config(cfg, get_profile_filename());
-                } else if (other_input == "6") {
-                    cfg.big_horn_button = -1;
-                    cfg.small_horn_button = -1;
-                    cfg.credit_button = -1;
-                    cfg.test_menu_button = -1;
-                    cfg.debug_mission_button = -1;
-                    print_colored(tr("All input mappings cleared.", cfg.language) + "\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
-                    save_config(cfg, get_profile_filename());
-                } else {
-                    print_colored(tr("Invalid option.", cfg.language) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
-                }
+        }
+    }
+
+    // Call from the main loop. Returns true after switching profiles;
+    // 'cfg' is then the new profile's settings.
+    bool poll(Config& cfg) {
+        if (rules.empty() || Clock::now() - last_poll < std::chrono::milliseconds(FOREGROUND_POLL_MS)) return false;
+        last_poll = Clock::now();
+        WindowIdentity window;
+        if (!foreground_window().identity(window) || (window_known && window == last_window)) return false;
+        last_window = window;
+        window_known = true;
+        const std::string* wanted = rules.match(window);
+        std::string target = (wanted && preloaded.count(*wanted)) ? *wanted : std::string();
+        if (target == active) return false;
+        if (active.empty()) manual = cfg; // keep edits made since the last switch
+        std::shared_ptr<PreparedConfig> prepared =
+            target.empty() ? std::make_shared<PreparedConfig>(prepare_config(manual)) : std::make_shared<PreparedConfig>(*preloaded[target]);
+        active = target;
+        std::string language = cfg.language;
+        cfg = prepared->config;
+        cfg.language = language;
+        translator.post_reload(prepared, ReloadNotice::ProfileSwitched);
+        source.wake();
+        return true;
+    }
+
+    // Keep a preloaded profile in step with hot-reloaded edits
+    void update(const Config& cfg) {
+        auto it = preloaded.find(cfg.profile);
+        if (it != preloaded.end()) it->second = std::make_shared<const PreparedConfig>(prepare_config(cfg));
+    }
+
+private:
+    Translator& translator;
+    InputSource& source;
+    ProfileRules rules;
+    std::map<std::string, std::shared_ptr<const PreparedConfig>> preloaded;
+    Config manual;
+    std::string active; // profile chosen by a rule, empty = the manual one
+    WindowIdentity last_window;
+    bool window_known = false;
+    Clock::time_point last_poll;
+};
+
+// How long to let a burst of writes to the profile settle before parsing it
+const int RELOAD_SETTLE_MS = 50;
+
+// Watches the active profile's .cfg on its own thread. When the file is
+// saved (e.g. from an external editor) it is parsed and its decode tables
+// built there, then handed to the translator, which switches over on its
+// next tick; input translation never pauses. The main thread picks up the
+// same settings with take() so the settings menu shows (and saves) them.
+class ConfigReloader {
+public:
+    ConfigReloader(Translator& t, InputSource& s) : translator(t), source(s) {}
+    ~ConfigReloader() { stop(); }
+
+    void start(const std::string& file) {
+        watch(file);
+        worker = std::thread(&ConfigReloader::run, this);
+    }
+
+    void stop() {
+        watcher.stop();
+        if (worker.joinable()) worker.join();
+    }
+
+    // Ignore changes while the settings menu is writing the profile itself
+    void pause() {
+        std::lock_guard<std::mutex> lock(mtx);
+        paused = true;
+    }
+
+    // (Re)start watching, e.g. after the settings menu switched profiles
+    void watch(const std::string& file) {
+        std::lock_guard<std::mutex> lock(mtx);
+        filename = file;
+        paused = false;
+        has_latest = false;
+    }
+
+    // Settings reloaded since the last call, if any
+    bool take(Config& cfg) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!has_latest) return false;
+        cfg = latest;
+        has_latest = false;
+        return true;
+    }
+
+private:
+    void run() {
+        std::vector<std::string> names;
+        while (watcher.wait(names)) {
+            std::string file;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (paused) continue;
+                file = filename;
             }
-            continue;
-        } else if (opt == 9) {
-            std::string new_lang = select_language(cfg.language);
-            cfg.language = new_lang;
-            save_config(cfg, get_profile_filename());
-            load_translations(cfg.language); // reload translations
-            print_colored(tr("Language changed!", cfg.language) + "\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
-            // Update header after language change
-            system("cls");
-            print_colored("=================================\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-            print_colored(tr("Mascon Lever Input Translator", cfg.language) + "\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-            print_colored("=================================\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-            std::cout << tr("Using joystick #", cfg.language);
-            print_colored(std::to_string(selected_id), FOREGROUND_PINK | FOREGROUND_INTENSITY);
-            std::cout << ": ";
-            std::cout << SDL_JoystickNameForIndex(selected_id);
-            std::cout << std::endl;
-            std::cout << tr("Output mode: ", cfg.language);
-            print_colored((mode == 0 ? tr("Up/Down Arrow Keys", cfg.language) : tr("Mouse Scroll", cfg.language)), FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
-            std::cout << ": ";
-            std::cout << SDL_JoystickNameForIndex(selected_id);
-            std::cout << std::endl;
-            std::cout << tr("Output mode: ", cfg.language);
-            print_colored((mode == 0 ? tr("Up/Down Arrow Keys", cfg.language) : tr("Mouse Scroll", cfg.language)), FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
-            std::cout << std::endl;
-            std::cout << "---------------------------------\n";
-            std::cout << tr("Press ", cfg.language);
-            print_colored(tr("Tab", cfg.language), FOREGROUND_LIME);
-            std::cout << tr(" to open settings menu.", cfg.language) << std::endl;
-            std::cout << tr("Press ", cfg.language);
-            print_colored(tr("Esc", cfg.language), FOREGROUND_RED | FOREGROUND_INTENSITY);
-            std::cout << tr(" to exit.", cfg.language) << std::endl;
-            std::cout << "---------------------------------\n";
-            continue;
-        } else if (opt == 10 && mode == 2) { // Only allow option 9 if mode 2
-            // Set lever-to-key mapping (mode 2)
-            static const std::vector<std::string> lever_names = {
-                "B9", "B8", "B7", "B6", "B5", "B4", "B3", "B2", "B1", "Neutral",
-                "P1", "P2", "P3", "P4", "P5"
-            };
-            print_colored("\n" + tr("Set a key for each lever position. Enter a single character (e.g. a, 1, space), or a Windows virtual-key code (e.g. 0x41 for 'A', 0x31 for '1', 0x25 for Left Arrow, etc). Enter 0 for none.", cfg.language) + "\n", COLOR_PROMPT);
-            for (int i = 0; i < 15; ++i) {
-                std::cout << lever_names[i] << " (current: 0x" << std::hex << cfg.lever_keycodes[i] << std::dec << "): ";
-                std::string key_input;
-                std::getline(std::cin, key_input);
-                if (!key_input.empty()) {
-                    try {
-                        // Trim whitespace
-                        key_input.erase(0, key_input.find_first_not_of(" \t"));
-                        key_input.erase(key_input.find_last_not_of(" \t") + 1);
-                        if (key_input == "0") {
-                            cfg.lever_keycodes[i] = 0;
-                        } else if (key_input.length() == 1) {
-                            // Single character: convert to virtual-key code
-                            char ch = key_input[0];
-                            SHORT vk = VkKeyScanA(ch);
-                            if (vk != -1) {
-                                cfg.lever_keycodes[i] = vk & 0xFF;
-                            } else {
-                                print_colored(tr("Unrecognized character. Please enter a valid key or code.\n", cfg.language), COLOR_ERROR);
-                            }
-                        } else if (key_input.length() > 1 && (key_input[0] == '0' && (key_input[1] == 'x' || key_input[1] == 'X'))) {
-                            cfg.lever_keycodes[i] = std::stoi(key_input, nullptr, 16);
-                        } else {
-                            cfg.lever_keycodes[i] = std::stoi(key_input, nullptr, 0);
-                        }
-                    } catch (...) {
-                        print_colored(tr("Invalid input! Please enter a valid key or code.\n", cfg.language), COLOR_ERROR);
-                    }
+            bool hit = false;
+            for (const auto& name : names) {
+                if (name.empty() || name == file) hit = true;
+            }
+            if (!hit) continue;
+            std::this_thread::sleep_for(std::chrono::milliseconds(RELOAD_SETTLE_MS));
+            // Our own saves (settings menu, daemon "set") are not external edits
+            std::string contents;
+            if (!read_file(file, contents) || config_writer().wrote(file, contents)) continue;
+            Config cfg;
+            if (!load_config(cfg, file)) continue; // half-written or broken: keep the current settings
+            std::shared_ptr<PreparedConfig> prepared = std::make_shared<PreparedConfig>(prepare_config(cfg));
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (paused || file != filename) continue;
+                latest = cfg;
+                has_latest = true;
+            }
+            translator.post_reload(prepared);
+            source.wake();
+        }
+    }
+
+    Translator& translator;
+    InputSource& source;
+    PlatformFileWatcher watcher;
+    std::thread worker;
+    std::mutex mtx;
+    std::string filename;
+    bool paused = false;
+    Config latest;
+    bool has_latest = false;
+};
+
+// Same loop as run_input_thread, but on the trace's virtual clock and with
+// the output scheduler driven from this thread
+void run_replay(Translator& translator, TraceInputSource& source, OutputScheduler& output) {
+    source.reseed();
+    int wait_ms = translator.tick(source.snapshot());
+    while (!source.finished()) {
+        source.wait(wait_ms < 0 ? INPUT_IDLE_WAIT_MS : wait_ms);
+        output.run_until(source.now());
+        wait_ms = translator.tick(source.snapshot());
+    }
+    // Like stop() on exit: send everything still queued
+    output.run_until(Clock::time_point::max());
+}
+
+// Replays a trace into 'sink' (timed on the virtual clock) and returns the
+// wall-clock time it took in ms
+double replay_trace(TraceInputSource& source, const Config& config, int mode, RecordingOutputSink& sink) {
+    OutputScheduler output(sink);
+    sink.start([&output] { return output.now(); }, Clock::time_point());
+    AsyncLogger logger; // not started: replays run without console logging
+    Translator translator;
+    translator.output = &output;
+    translator.logger = &logger;
+    translator.load(config, mode, config.language);
+    auto wall_start = Clock::now();
+    run_replay(translator, source, output);
+    return std::chrono::duration<double, std::milli>(Clock::now() - wall_start).count();
+}
+
+// Helper to print how long a replay took
+void print_replay_summary(const TraceInputSource& source, const RecordingOutputSink& sink, int mode, double wall_ms) {
+    double trace_ms = source.duration_us() / 1000.0;
+    std::cout << "Replayed " << source.record_count() << " records (" << trace_ms << " ms of input) in mode " << mode
+              << " in " << wall_ms << " ms";
+    if (wall_ms > 0) {
+        std::cout << " (" << trace_ms / wall_ms << "x real time, " << (uint64_t)(sink.events.size() * 1000.0 / wall_ms) << " events/s)";
+    }
+    std::cout << "\n" << sink.events.size() << " output events" << std::endl;
+}
+
+// --replay: feed a recorded trace through the translator offline, and
+// optionally save the output events (--out) e.g. to make a golden file
+int replay_main(const std::string& trace_file, const std::string& out_file, const Config& config, int mode) {
+    TraceInputSource source;
+    if (!source.load(trace_file)) {
+        std::cerr << "Could not read trace file " << trace_file << std::endl;
+        return 1;
+    }
+    RecordingOutputSink sink;
+    double wall_ms = replay_trace(source, config, mode, sink);
+    print_replay_summary(source, sink, mode, wall_ms);
+    if (!out_file.empty() && !sink.write(out_file)) {
+        std::cerr << "Could not write " << out_file << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// --golden: replay a trace and compare the output events with a golden
+// file made by --replay --out. Returns 0 if they match, 1 otherwise.
+int golden_main(const std::string& trace_file, const std::string& golden_file, const Config& config, int mode) {
+    TraceInputSource source;
+    if (!source.load(trace_file)) {
+        std::cerr << "Could not read trace file " << trace_file << std::endl;
+        return 1;
+    }
+    std::ifstream golden(golden_file, std::ios::binary);
+    if (!golden) {
+        std::cerr << "Could not read golden file " << golden_file << std::endl;
+        return 1;
+    }
+    RecordingOutputSink sink;
+    double wall_ms = replay_trace(source, config, mode, sink);
+    print_replay_summary(source, sink, mode, wall_ms);
+    std::istringstream actual(sink.format());
+    std::string expected_line, actual_line;
+    int line = 0;
+    while (true) {
+        bool more_expected = (bool)std::getline(golden, expected_line);
+        bool more_actual = (bool)std::getline(actual, actual_line);
+        if (!more_expected && !more_actual) break;
+        ++line;
+        if (!more_expected) expected_line = "<end of file>";
+        if (!more_actual) actual_line = "<end of output>";
+        if (!expected_line.empty() && expected_line.back() == '\r') expected_line.pop_back();
+        if (expected_line != actual_line) {
+            std::cout << "FAIL " << trace_file << " line " << line << ": expected \"" << expected_line << "\", got \"" << actual_line << "\"" << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "PASS " << trace_file << std::endl;
+    return 0;
+}
+
+// --bench: timings for the hot paths, appended to a results file so
+// performance changes can be compared over time. No mascon needed.
+volatile int64_t bench_sink; // keeps results alive so the work isn't optimised away
+const int BENCH_MIN_MS = 200;
+
+// Calls fn (which does 'batch' operations) until BENCH_MIN_MS have passed
+// and returns the time per operation in ns
+template <typename F>
+double bench_ns(F fn, int batch) {
+    fn(); // warm up
+    uint64_t calls = 0;
+    auto start = Clock::now();
+    Clock::duration elapsed;
+    do {
+        fn();
+        ++calls;
+        elapsed = Clock::now() - start;
+    } while (elapsed < std::chrono::milliseconds(BENCH_MIN_MS));
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ((double)calls * batch);
+}
+
+void bench_report(std::ostream& out, const std::string& name, double ns) {
+    char line[128];
+    snprintf(line, sizeof(line), "%-48s %10.1f ns/op\n", name.c_str(), ns);
+    out << line;
+    std::cout << line << std::flush;
+}
+
+// match_combo against LeverDecoder for several button counts and mapping sizes
+void bench_decode(std::ostream& out) {
+    const int BUTTON_COUNTS[] = {16, 32, 64, 128};
+    const int MAPPING_SIZES[] = {15, 32};
+    const int SAMPLES = 256;
+    std::mt19937 rng(12345);
+    for (int buttons : BUTTON_COUNTS) {
+        for (int positions : MAPPING_SIZES) {
+            std::vector<std::set<int>> combos(positions);
+            for (auto& combo : combos) {
+                size_t size = 1 + rng() % 4;
+                while (combo.size() < size) combo.insert((int)(rng() % buttons));
+            }
+            LeverDecoder decoder;
+            decoder.build(combos);
+            // A mapped position plus the odd unrelated button held down
+            std::vector<std::set<int>> pressed_sets(SAMPLES);
+            std::vector<ButtonMask> pressed_masks(SAMPLES);
+            for (int i = 0; i < SAMPLES; ++i) {
+                pressed_sets[i] = combos[rng() % positions];
+                if (rng() % 4 == 0) pressed_sets[i].insert((int)(rng() % buttons));
+                for (int b : pressed_sets[i]) pressed_masks[i].set(b);
+            }
+            std::string suffix = "/" + std::to_string(buttons) + " buttons/" + std::to_string(positions) + " positions";
+            bench_report(out, "decode/match_combo" + suffix, bench_ns([&] {
+                int64_t acc = 0;
+                for (const auto& pressed : pressed_sets) acc += match_combo(pressed, combos);
+                bench_sink = acc;
+            }, SAMPLES));
+            bench_report(out, "decode/LeverDecoder" + suffix, bench_ns([&] {
+                int64_t acc = 0;
+                for (const auto& pressed : pressed_masks) acc += decoder.decode(pressed);
+                bench_sink = acc;
+            }, SAMPLES));
+        }
+    }
+}
+
+// The default mapping through its known-layout table and the generic table
+void bench_known_layout(std::ostream& out) {
+    const int SAMPLES = 256;
+    std::mt19937 rng(12345);
+    std::vector<ButtonMask> pressed_masks(SAMPLES);
+    for (auto& pressed : pressed_masks) {
+        for (int b : default_config.lever_mappings[rng() % LEVER_POSITIONS]) pressed.set(b);
+    }
+    for (int known = 1; known >= 0; --known) {
+        LeverDecoder decoder;
+        decoder.build(default_config.lever_mappings, known != 0);
+        bench_report(out, std::string("decode/default mapping/") + (known ? "known layout" : "generic table"), bench_ns([&] {
+            int64_t acc = 0;
+            for (const auto& pressed : pressed_masks) acc += decoder.decode(pressed);
+            bench_sink = acc;
+        }, SAMPLES));
+    }
+}
+
+// Translator::tick on a lever swinging B9 <-> P5, one tick per virtual ms,
+// with the scheduler run in manual mode
+void bench_translator(std::ostream& out, int mode) {
+    const int TICKS = 4096;
+    const int NOTCH_MS = 40;
+    NullOutputSink sink;
+    OutputScheduler output(sink);
+    AsyncLogger logger;
+    Translator translator;
+    translator.output = &output;
+    translator.logger = &logger;
+    translator.load(default_config, mode, "en");
+    std::vector<ButtonMask> masks(TICKS);
+    for (int i = 0; i < TICKS; ++i) {
+        int step = (i / NOTCH_MS) % 28;
+        int pos = step < 14 ? step : 28 - step;
+        for (int b : default_config.lever_mappings[pos]) masks[i].set(b);
+    }
+    Clock::time_point base;
+    bench_report(out, "translator/tick/mode " + std::to_string(mode), bench_ns([&] {
+        InputSnapshot snap;
+        for (int i = 0; i < TICKS; ++i) {
+            snap.buttons = masks[i];
+            snap.timestamp = base + std::chrono::milliseconds(i);
+            translator.tick(snap);
+            output.run_until(snap.timestamp);
+            logger.discard_pending();
+        }
+        base += std::chrono::milliseconds(TICKS);
+    }, TICKS));
+}
+
+void bench_tr(std::ostream& out, const std::string& lang) {
+    const int BATCH = 256;
+    // Switching language: JSON files against the precompiled pack (if built)
+    bench_report(out, "tr/load json", bench_ns([&lang] {
+        TranslationCatalog catalog;
+        catalog.build(read_language_file("en"), lang == "en" ? TranslationCatalog::Entries() : read_language_file(lang));
+        bench_sink = (int64_t)catalog.size();
+    }, 1));
+    std::string pack;
+    if (read_file(language_pack_path(lang), pack)) {
+        bench_report(out, "tr/load pack", bench_ns([&lang] {
+            std::string pack;
+            std::vector<std::pair<std::string_view, std::string_view>> entries;
+            TranslationCatalog catalog;
+            if (read_file(language_pack_path(lang), pack) && parse_language_pack(pack, entries)) catalog.build(entries, TranslationCatalog::Entries());
+            bench_sink = (int64_t)catalog.size();
+        }, 1));
+    }
+    bench_report(out, "tr/hit", bench_ns([] {
+        size_t acc = 0;
+        for (int i = 0; i < BATCH; ++i) acc += tr("Neutral position!").size();
+        bench_sink = (int64_t)acc;
+    }, BATCH));
+    bench_report(out, "tr/hit (TR_KEY)", bench_ns([] {
+        size_t acc = 0;
+        for (int i = 0; i < BATCH; ++i) acc += tr(TR_KEY("Neutral position!")).size();
+        bench_sink = (int64_t)acc;
+    }, BATCH));
+    bench_report(out, "tr/miss", bench_ns([] {
+        size_t acc = 0;
+        for (int i = 0; i < BATCH; ++i) acc += tr("No such translation key").size();
+        bench_sink = (int64_t)acc;
+    }, BATCH));
+}
+
+void bench_config(std::ostream& out) {
+    const std::string filename = "bench_config.tmp";
+    Config cfg;
+    // What the settings menu pays per save: serialize and queue
+    bench_report(out, "config/save_config", bench_ns([&] { save_config(cfg, filename); }, 1));
+    flush_config_saves();
+    // The writer thread's side, for unchanged and changed settings
+    bench_report(out, "config/write unchanged", bench_ns([&] { write_file_atomically(filename, serialize_config(cfg)); }, 1));
+    bench_report(out, "config/write changed", bench_ns([&] {
+        cfg.debounce_ms ^= 1;
+        write_file_atomically(filename, serialize_config(cfg));
+    }, 1));
+    bench_report(out, "config/load_config", bench_ns([&] { bench_sink = load_config(cfg, filename); }, 1));
+    std::remove(filename.c_str());
+}
+
+// Listing and switching profiles: directory scan and parse against the index
+void bench_profiles(std::ostream& out) {
+    bench_report(out, "profiles/scan and load", bench_ns([] {
+        size_t n = 0;
+        for (const std::string& fname : list_files_with_extension(".cfg")) {
+            Config cfg;
+            n += load_config(cfg, fname);
+        }
+        bench_sink = (int64_t)n;
+    }, 1));
+    profile_index().start();
+    bench_report(out, "profiles/index list and find", bench_ns([] {
+        size_t n = 0;
+        for (const std::string& name : profile_index().names()) n += profile_index().find(name) != nullptr;
+        bench_sink = (int64_t)n;
+    }, 1));
+}
+
+// The input thread's side of logging: queue a record (the logger thread
+// does the formatting and console output)
+void bench_log(std::ostream& out) {
+    const int BATCH = 256;
+    AsyncLogger logger;
+    bench_report(out, "log/enqueue", bench_ns([&] {
+        for (int i = 0; i < BATCH; ++i) logger.log(LogEvent::LeverStep, i % 14, i % 14 + 1);
+        bench_sink = (int64_t)logger.discard_pending();
+    }, BATCH));
+}
+
+int bench_main(const std::string& results_file, const Config& config) {
+    load_translations(config.language);
+    std::ostringstream out;
+    std::time_t now = std::time(nullptr);
+    char date[64];
+    std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+    out << "# " << date << "\n";
+    bench_decode(out);
+    bench_known_layout(out);
+    for (int mode = 0; mode <= 2; ++mode) bench_translator(out, mode);
+    bench_tr(out, config.language);
+    bench_config(out);
+    bench_profiles(out);
+    bench_log(out);
+    std::ofstream file(results_file, std::ios::app);
+    if (!file || !(file << out.str() << "\n")) {
+        std::cerr << "Could not write " << results_file << std::endl;
+        return 1;
+    }
+    std::cout << "Results appended to " << results_file << std::endl;
+    return 0;
+}
+
+// --daemon [endpoint]: headless mode for unattended cabinets. Runs the same
+// input/output pipeline as the console UI, without the menus and hotkeys.
+// The main thread serves a local control endpoint (Unix-domain socket, or a
+// named pipe on Windows) that speaks JSON lines: one request object per
+// line, one response object per line. The input thread is only paused for
+// a mode change, like the settings menu does.
+//   {"cmd":"stats"}                                  profile, mode and latency per channel
+//   {"cmd":"get"}                                    all settings
+//   {"cmd":"set","key":"debounce_ms","value":30}     change one setting; "save":true also writes the profile
+//   {"cmd":"profile","name":"Game"}                  switch profiles
+//   {"cmd":"mode","mode":1}                          switch output mode (0, 1 or 2)
+//   {"cmd":"shutdown"}                               stop the daemon
+// Longest request line accepted before the client is dropped
+const size_t CONTROL_MAX_LINE = 64 * 1024;
+
+std::string default_control_endpoint() {
+#ifdef _WIN32
+    return "\\\\.\\pipe\\mascon_translator";
+#else
+    const char* dir = getenv("XDG_RUNTIME_DIR");
+    return (dir && *dir) ? std::string(dir) + "/mascon_translator.sock" : "mascon_translator.sock";
+#endif
+}
+
+// Set from the signal/console control handler or by the shutdown command
+std::atomic<bool> daemon_stop_requested(false);
+ControlServer* daemon_control_server = nullptr;
+
+#ifdef _WIN32
+BOOL WINAPI daemon_console_handler(DWORD) {
+    daemon_stop_requested = true;
+    if (daemon_control_server) daemon_control_server->stop();
+    return TRUE;
+}
+#else
+void daemon_signal_handler(int) {
+    daemon_stop_requested = true;
+    if (daemon_control_server) daemon_control_server->stop(); // only writes to a pipe
+}
+#endif
+
+// What the control requests act on; owned by daemon_main
+struct DaemonState {
+    Config& config;
+    int& mode;
+    const std::string& lang;
+    Translator& translator;
+    InputSource& source;
+    InputThreadControl& input_ctl;
+    ConfigReloader& reloader;
+};
+
+nlohmann::json control_error(const std::string& message) {
+    return nlohmann::json{{"ok", false}, {"error", message}};
+}
+
+nlohmann::json config_field_json(const Config& cfg, const ConfigField& field) {
+    switch (field.kind) {
+    case ConfigFieldKind::Int: return cfg.*field.int_value;
+    case ConfigFieldKind::Bool: return cfg.*field.bool_value;
+    case ConfigFieldKind::String: return cfg.*field.string_value;
+    case ConfigFieldKind::IntList: return cfg.*field.list_value;
+    case ConfigFieldKind::InputRef: {
+        int value = cfg.*field.int_value;
+        if (value < field.stride) return value;
+        return format_input_ref(value, field.stride); // "device:index"
+    }
+    }
+    return nullptr;
+}
+
+// Helper to turn a JSON value into the text the config parser expects
+bool config_value_text(const nlohmann::json& value, std::string& text) {
+    if (value.is_boolean()) text = value.get<bool>() ? "1" : "0";
+    else if (value.is_number_integer()) text = value.dump(); // exact digits; out-of-range values then fail to parse
+    else if (value.is_string()) text = value.get<std::string>();
+    else if (value.is_array()) {
+        text.clear();
+        for (const auto& v : value) {
+            if (!v.is_number_integer()) return false;
+            text += (text.empty() ? "" : " ") + v.dump();
+        }
+    } else return false;
+    return true;
+}
+
+// Hands the daemon's settings to the input thread, which switches on its next tick
+void post_daemon_config(DaemonState& st) {
+    st.translator.post_reload(std::make_shared<PreparedConfig>(prepare_config(st.config)), ReloadNotice::None);
+    st.source.wake();
+}
+
+nlohmann::json handle_control_request(DaemonState& st, const nlohmann::json& req, bool& shutdown) {
+    // Pick up edits made to the profile file since the last request
+    Config reloaded;
+    if (st.reloader.take(reloaded)) {
+        reloaded.language = st.config.language;
+        st.config = reloaded;
+    }
+    const std::string cmd = req.value("cmd", std::string());
+    if (cmd == "stats") {
+        static const char* channel_keys[LAT_CHANNELS] = { "arrow", "scroll", "lever_key", "special" };
+        nlohmann::json latency = nlohmann::json::object();
+        for (int c = 0; c < LAT_CHANNELS; ++c) {
+            const LatencyHistogram& h = latency_stats.hist[c][LAT_TOTAL];
+            latency[channel_keys[c]] = {{"count", h.count()}, {"p50_us", h.percentile(50)}, {"p99_us", h.percentile(99)}, {"max_us", h.max()}};
+        }
+        return {{"ok", true}, {"profile", st.config.profile}, {"mode", st.mode}, {"latency", latency}};
+    }
+    if (cmd == "get") {
+        nlohmann::json settings = nlohmann::json::object();
+        for (const auto& field : CONFIG_FIELDS) settings[std::string(field.key)] = config_field_json(st.config, field);
+        return {{"ok", true}, {"settings", settings}};
+    }
+    if (cmd == "set") {
+        const std::string key = req.value("key", std::string());
+        const ConfigField* field = find_config_field(key);
+        if (!field) return control_error("unknown key: " + key);
+        if (key == "profile") return control_error("use the profile command to switch profiles");
+        if (key == "last_mode") return control_error("use the mode command to switch output modes");
+        // Only read at startup; a running daemon would report them changed without using them
+        if (key == "language" || key == "last_joystick" || key == "joystick_guid" || key == "extra_joysticks") {
+            return control_error(key + " can only be changed in the profile file, then restart the daemon");
+        }
+        std::string text;
+        if (!req.contains("value") || !config_value_text(req["value"], text)) return control_error("missing or invalid value");
+        if (!valid_config_value(*field, text)) {
+            if (field->kind == ConfigFieldKind::Int) {
+                return control_error("invalid value for " + key + ": expected an integer from " + std::to_string(field->min_value) + " to " +
+                                     std::to_string(field->max_value));
+            }
+            return control_error("invalid value for " + key);
+        }
+        apply_config_field(st.config, *field, text);
+        post_daemon_config(st);
+        if (req.value("save", false)) save_config(st.config, profile_filename(st.config)); // the reloader skips our own writes
+        return {{"ok", true}, {"key", key}, {"value", config_field_json(st.config, *field)}};
+    }
+    if (cmd == "profile") {
+        const std::string name = req.value("name", std::string());
+        const Config* found = profile_index().find(name);
+        if (!found) return control_error("unknown profile: " + name);
+        std::string language = st.config.language;
+        st.config = *found;
+        st.config.language = language;
+        post_daemon_config(st);
+        st.reloader.watch(profile_filename(st.config));
+        return {{"ok", true}, {"profile", st.config.profile}};
+    }
+    if (cmd == "mode") {
+        int new_mode = req.value("mode", -1);
+        if (new_mode < 0 || new_mode > 2) return control_error("mode must be 0, 1 or 2");
+        pause_input_thread(st.input_ctl, st.source);
+        st.mode = new_mode;
+        st.config.last_mode = new_mode;
+        st.translator.load(st.config, st.mode, st.lang);
+        resume_input_thread(st.input_ctl);
+        return {{"ok", true}, {"mode", st.mode}};
+    }
+    if (cmd == "shutdown") {
+        shutdown = true;
+        return {{"ok", true}};
+    }
+    return control_error("unknown command: " + cmd);
+}
+
+// Serves one client at a time until stopped or told to shut down
+void run_control_server(ControlServer& server, DaemonState& st) {
+    while (!daemon_stop_requested && server.accept()) {
+        std::string pending;
+        char buf[4096];
+        bool shutdown = false;
+        int n = 0;
+        while (!shutdown && (n = server.read(buf, sizeof(buf))) > 0) {
+            pending.append(buf, n);
+            size_t start = 0, end;
+            while (!shutdown && (end = pending.find('\n', start)) != std::string::npos) {
+                std::string line = pending.substr(start, end - start);
+                start = end + 1;
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (line.empty()) continue;
+                nlohmann::json response;
+                try {
+                    nlohmann::json req = nlohmann::json::parse(line);
+                    response = req.is_object() ? handle_control_request(st, req, shutdown) : control_error("request must be a JSON object");
+                } catch (const nlohmann::json::exception& e) {
+                    response = control_error(e.what());
                 }
+                server.write(response.dump() + "\n");
             }
-            save_config(cfg, get_profile_filename());
-            print_colored(tr("Lever-to-key mapping updated!", cfg.language) + "\n", COLOR_SUCCESS);
-            continue;
-        } else {
-            print_colored("Invalid option.\n\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+            pending.erase(0, start);
+            if (pending.size() > CONTROL_MAX_LINE) break;
         }
-        cfg.last_mode = mode;
-        cfg.last_joystick = selected_id;
-        save_config(cfg, get_profile_filename());
+        server.disconnect();
+        if (shutdown || n < 0) break;
+    }
+    daemon_stop_requested = true;
+}
+
+int daemon_main(const std::string& endpoint_arg, Config config) {
+    std::string endpoint = endpoint_arg.empty() ? default_control_endpoint() : endpoint_arg;
+    std::string lang = config.language.empty() ? "en" : config.language;
+    load_translations(lang);
+    profile_index().start();
+
+    PlatformControlServer server;
+    if (!server.listen(endpoint)) {
+        std::cerr << "Could not listen on " << endpoint << std::endl;
+        return 1;
+    }
+    SDL_SetHint(SDL_HINT_JOYSTICK_ALLOW_BACKGROUND_EVENTS, "1");
+    SDL_SetHint(SDL_HINT_JOYSTICK_THREAD, "1");
+    if (SDL_Init(SDL_INIT_JOYSTICK) < 0) {
+        std::cerr << "SDL could not initialize! SDL_Error: " << SDL_GetError() << std::endl;
+        return 1;
+    }
+    // Without the mascon plugged in, device 0 starts disconnected and is
+    // opened when it appears
+    SdlInputSource input_source;
+    int joy_index = input_source.open(config.joystick_guid, config.last_joystick);
+    input_source.set_extra_devices(split_words(config.extra_joysticks));
+    PlatformOutputSink output_sink;
+#ifndef _WIN32
+    if (!output_sink.ok()) {
+        std::cerr << tr("Failed to open /dev/uinput. Make sure the uinput module is loaded and you have write access to it.", lang) << std::endl;
+        input_source.close();
+        SDL_Quit();
+        return 1;
     }
+#endif
+    OutputScheduler output(output_sink);
+    output.start();
+    AsyncLogger logger;
+    logger.start(lang);
+    int mode = config.last_mode;
+    Translator translator;
+    translator.output = &output;
+    translator.logger = &logger;
+    translator.load(config, mode, lang);
+    InputThreadControl input_ctl;
+    std::thread input_thread(run_input_thread, std::ref(translator), std::ref(input_source), std::ref(input_ctl));
+    ConfigReloader reloader(translator, input_source);
+    reloader.start(profile_filename(config));
+
+    daemon_control_server = &server;
+#ifdef _WIN32
+    SetConsoleCtrlHandler(daemon_console_handler, TRUE);
+#else
+    signal(SIGINT, daemon_signal_handler);
+    signal(SIGTERM, daemon_signal_handler);
+#endif
+    if (joy_index >= 0) std::cout << "Joystick #" << joy_index << ": " << SDL_JoystickNameForIndex(joy_index) << ", listening on " << endpoint << std::endl;
+    else std::cout << "Waiting for the mascon, listening on " << endpoint << std::endl;
+    DaemonState state{config, mode, lang, translator, input_source, input_ctl, reloader};
+    run_control_server(server, state);
+
+    daemon_control_server = nullptr;
+    reloader.stop();
+    stop_input_thread(input_ctl, input_source, input_thread);
+    output.stop(); // flushes pending key-ups
+    logger.stop();
+    flush_config_saves();
+    input_source.close();
+    SDL_Quit();
+    std::cout << "Daemon stopped." << std::endl;
+    return 0;
 }
 
 // Forward declaration for language selection
@@ -980,49 +5392,91 @@ int main(int argc, char* argv[]) {
     Config config;
     bool config_exists = load_config(config, "mascon_translator.cfg");
 
+    // Command line: --record <file> saves the joystick input as a trace and
+    // --record-output <file> the emitted key/wheel events;
+    // --replay <file> [--mode N] [--out <file>] runs a trace through the translator offline;
+    // --golden <trace> <expected> [--mode N] checks a replay against a golden file;
+    // --bench [results file] times the hot paths;
+    // --build-langpacks compiles lang/*.json into binary language packs;
+    // --daemon [endpoint] runs headless, controlled over a local socket/pipe
+    std::string record_file, record_output_file, replay_file, replay_out_file, golden_file, bench_file, daemon_endpoint;
+    bool daemon = false;
+    int replay_mode = config.last_mode;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc) record_file = argv[++i];
+        else if (arg == "--record-output" && i + 1 < argc) record_output_file = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc) replay_file = argv[++i];
+        else if (arg == "--out" && i + 1 < argc) replay_out_file = argv[++i];
+        else if (arg == "--golden" && i + 2 < argc) {
+            replay_file = argv[++i];
+            golden_file = argv[++i];
+        } else if (arg == "--mode" && i + 1 < argc) replay_mode = atoi(argv[++i]);
+        else if (arg == "--bench") bench_file = (i + 1 < argc && argv[i + 1][0] != '-') ? argv[++i] : "bench_results.txt";
+        else if (arg == "--build-langpacks") return build_langpacks_main();
+        else if (arg == "--daemon") {
+            daemon = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') daemon_endpoint = argv[++i];
+        }
+    }
+    if (daemon) return daemon_main(daemon_endpoint, config);
+    if (!bench_file.empty()) return bench_main(bench_file, config);
+    if (!golden_file.empty()) return golden_main(replay_file, golden_file, config, replay_mode);
+    if (!replay_file.empty()) return replay_main(replay_file, replay_out_file, config, replay_mode);
+
     // Always show language selection menu first if config file does not exist
     if (!config_exists || config.language.empty()) {
         config.language = select_language("");
         save_config(config, "mascon_translator.cfg");
-        system("cls"); // Clear screen after language selection
+        clear_screen(); // Clear screen after language selection
     }
     std::string lang = config.language;
 
     // Load translations from JSON
     load_translations(lang);
+    profile_index().start();
 
     int mode = config.last_mode;
     int selected_id = config.last_joystick;
 
+    // Keep receiving joystick events while the game has focus, and let SDL
+    // handle device messages on its own thread so our input thread can wait on events
+    SDL_SetHint(SDL_HINT_JOYSTICK_ALLOW_BACKGROUND_EVENTS, "1");
+    SDL_SetHint(SDL_HINT_JOYSTICK_THREAD, "1");
     if (SDL_Init(SDL_INIT_JOYSTICK) < 0) {
         std::cerr << "SDL could not initialize! SDL_Error: " << SDL_GetError() << std::endl;
         return 1;
     }
 
+    // Wait for the mascon itself, not just any joystick (e.g. the pedal box)
     int num_joysticks = SDL_NumJoysticks();
-    while (num_joysticks == 0) {
+    while (!mascon_present(config.joystick_guid)) {
         print_colored(tr("Mascon not detected. Plug in your mascon and press Enter to retry.", lang) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
         // Wait for either Enter or Tab
+        console().set_raw(true);
         while (true) {
-            if (GetAsyncKeyState(VK_TAB) & 0x8000) {
-                system("cls");
+            int ch = console().kbhit() ? console().getch() : 0;
+            if (ch == KEY_CODE_TAB) {
+                console().set_raw(false);
+                clear_screen();
                 print_colored("\nTab pressed. Opening settings menu...\n", FOREGROUND_LIME);
-                settings_menu(config, "mascon_translator.cfg", mode, selected_id, num_joysticks);
+                settings_menu(config, "mascon_translator.cfg", mode, selected_id);
                 lang = config.language; // Update language after settings menu
-                system("cls");
+                clear_screen();
                 print_colored(tr("Mascon not detected. Plug in your mascon and press Enter to retry.", lang) + " " + tr("Press ", lang) + tr("Tab", lang) + tr(" to open settings menu.", lang) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
                 std::this_thread::sleep_for(std::chrono::milliseconds(300));
+                console().set_raw(true);
             }
-            if (_kbhit()) {
-                int ch = _getch();
-                if (ch == 13) { // Enter key
-                    break;
-                }
+            if (ch == KEY_CODE_ENTER) { // Enter key
+                break;
             }
+            // SDL notices devices being plugged in by itself
+            SDL_JoystickUpdate();
+            if (mascon_present(config.joystick_guid)) break;
             std::this_thread::sleep_for(std::chrono::milliseconds(50));
         }
-        SDL_Quit();
-        SDL_Init(SDL_INIT_JOYSTICK);
+        console().set_raw(false);
+        SDL_JoystickUpdate();
         num_joysticks = SDL_NumJoysticks();
     }
     if (num_joysticks == 0) {
@@ -1065,7 +5519,7 @@ int main(int argc, char* argv[]) {
         }
 
         // Clear screen after joystick selection
-        system("cls");
+        clear_screen();
 
         SDL_Joystick* joy = SDL_JoystickOpen(selected_id);
         if (!joy) {
@@ -1108,304 +5562,182 @@ int main(int argc, char* argv[]) {
             }
         }
         // Clear screen after mode selection
-        system("cls");
+        clear_screen();
         SDL_JoystickClose(joy);
         // Save config for next boot
         config.last_joystick = selected_id;
+        config.joystick_guid = joystick_guid(selected_id);
         config.last_mode = mode;
         save_config(config, "mascon_translator.cfg");
     }
 
+    // Open joystick for main loop; the saved GUID finds the mascon again
+    // even if its index changed since it was chosen
+    SdlInputSource input_source;
+    int joy_index = input_source.open(config.joystick_guid, selected_id);
+    if (joy_index < 0 && config.joystick_guid.empty()) {
+        print_colored(tr("Failed to open joystick.", lang) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+        SDL_Quit();
+        return 1;
+    }
+    // -1: unplugged again since the check above; opened when it comes back
+    if (joy_index >= 0) selected_id = joy_index;
+    config.joystick_guid = input_source.guid(); // saved with the next settings change
+    std::string extra_devices = config.extra_joysticks;
+    input_source.set_extra_devices(split_words(extra_devices));
+
     // Clear screen before main loop
-    system("cls");
+    clear_screen();
     print_colored("=================================\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-    print_colored(tr("Mascon Lever Input Translator", lang) + "\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+    print_colored(tr(TR_KEY("Mascon Lever Input Translator"), lang) + "\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
     print_colored("=================================\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-    std::cout << tr("Using joystick #", lang);
+    std::cout << tr(TR_KEY("Using joystick #"), lang);
     print_colored(std::to_string(selected_id), FOREGROUND_PINK | FOREGROUND_INTENSITY);
     std::cout << ": ";
     std::cout << SDL_JoystickNameForIndex(selected_id);
     std::cout << std::endl;
-    std::cout << tr("Output mode: ", lang);
-    print_colored((mode == 0 ? tr("Up/Down Arrow Keys", lang) : tr("Mouse Scroll", lang)), FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
+    std::cout << tr(TR_KEY("Output mode: "), lang);
+    print_colored((mode == 0 ? tr(TR_KEY("Up/Down Arrow Keys"), lang) : tr(TR_KEY("Mouse Scroll"), lang)), FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
     std::cout << std::endl;
     std::cout << "---------------------------------\n";
-    std::cout << tr("Press ", lang);
-    print_colored(tr("Tab", lang), FOREGROUND_LIME);
-    std::cout << tr(" to open settings menu.", lang) << std::endl;
-    std::cout << tr("Press ", lang);
-    print_colored(tr("Esc", lang), FOREGROUND_RED | FOREGROUND_INTENSITY);
-    std::cout << tr(" to exit.", lang) << std::endl;
+    std::cout << tr(TR_KEY("Press "), lang);
+    print_colored(tr(TR_KEY("Tab"), lang), FOREGROUND_LIME);
+    std::cout << tr(TR_KEY(" to open settings menu."), lang) << std::endl;
+    std::cout << tr(TR_KEY("Press "), lang);
+    print_colored(tr(TR_KEY("Esc"), lang), FOREGROUND_RED | FOREGROUND_INTENSITY);
+    std::cout << tr(TR_KEY(" to exit."), lang) << std::endl;
     std::cout << "---------------------------------\n";
-    // Use lever mappings from config
-    std::vector<std::set<int>>& ordered_combos = config.lever_mappings;
-    std::vector<std::string> names = {
-        "B9", "B8", "B7", "B6", "B5", "B4", "B3", "B2", "B1", "Neutral",
-        "P1", "P2", "P3", "P4", "P5"
-    };
-    // Open joystick for main loop
-    SDL_Joystick* joy = SDL_JoystickOpen(selected_id);
-    if (!joy) {
-        print_colored(tr("Failed to open joystick.", lang) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+    print_colored("\x1b[35m" + tr("Input translation is active! Move the lever to send input ^w^", lang) + "\x1b[0m\n\n", FOREGROUND_PINK | FOREGROUND_INTENSITY);
+    PlatformOutputSink output_sink;
+#ifndef _WIN32
+    if (!output_sink.ok()) {
+        print_colored(tr("Failed to open /dev/uinput. Make sure the uinput module is loaded and you have write access to it.", lang) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+        input_source.close();
         SDL_Quit();
         return 1;
     }
-    HWND consoleWnd = GetConsoleWindow();
-    HWND parentWnd = GetParent(consoleWnd);
-    int last_idx = -1;
-    std::set<int> last_pressed;
-    int stable_idx = -1;
-    auto last_event_time = std::chrono::steady_clock::now();
-    // For credit repeat
-    auto last_credit_time = std::chrono::steady_clock::now() - std::chrono::milliseconds(250);
-    bool credit_prev_pressed = false;
-    print_colored("\x1b[35m" + tr("Input translation is active! Move the lever to send input ^w^", lang) + "\x1b[0m\n\n", FOREGROUND_PINK | FOREGROUND_INTENSITY);
-    std::set<int> pressed;
+#endif
+    RecordingOutputSink output_recorder(&output_sink);
+    OutputScheduler output(record_output_file.empty() ? (OutputSink&)output_sink : (OutputSink&)output_recorder);
+    output_recorder.start(Clock::now, Clock::now());
+    output.start();
+    AsyncLogger logger;
+    logger.start(lang);
+    Translator translator;
+    translator.output = &output;
+    translator.logger = &logger;
+    translator.load(config, mode, lang);
+    TraceRecorder recorder(input_source);
+    InputSource* source = &input_source;
+    if (!record_file.empty()) {
+        if (recorder.open(record_file)) source = &recorder;
+        else print_colored("Could not create trace file " + record_file + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+    }
+    InputThreadControl input_ctl;
+    std::thread input_thread(run_input_thread, std::ref(translator), std::ref(*source), std::ref(input_ctl));
+    ConfigReloader reloader(translator, *source);
+    reloader.start(profile_filename(config));
+    ProfileSwitcher profile_switcher(translator, *source);
+    profile_switcher.reset(config);
+    // Live latency overlay in the console title bar
+    auto last_title_update = Clock::now();
+    uint64_t last_title_count = 0;
+    // The main thread only watches the console hotkeys; joystick input is
+    // handled by the input thread
+    console().set_raw(true);
     while (true) {
-        HWND fgWnd = GetForegroundWindow();
-        // --- Always process other input buttons, regardless of focus ---
-        bool credit_pressed = false;
-        static bool big_horn_prev_pressed = false;
-        static bool small_horn_prev_pressed = false;
-        static bool test_menu_prev_pressed = false;
-        static bool debug_mission_prev_pressed = false;
-        if (config.big_horn_button >= 0 || config.small_horn_button >= 0 || config.credit_button >= 0 || config.test_menu_button >= 0 || config.debug_mission_button >= 0) {
-            SDL_JoystickUpdate();
-            int num_buttons = SDL_JoystickNumButtons(joy);
-            bool big_horn_now = false, small_horn_now = false, test_menu_now = false, debug_mission_now = false;
-            for (int b = 0; b < num_buttons; ++b) {
-                if (SDL_JoystickGetButton(joy, b)) {
-                    if (b == config.big_horn_button) big_horn_now = true;
-                    if (b == config.small_horn_button) small_horn_now = true;
-                    if (b == config.credit_button) credit_pressed = true;
-                    if (b == config.test_menu_button) test_menu_now = true;
-                    if (b == config.debug_mission_button) debug_mission_now = true;
-                }
+        HotkeyAction action = hotkeys().poll();
+        if (action == HOTKEY_EXIT) {
+            reloader.stop();
+            stop_input_thread(input_ctl, *source, input_thread);
+            recorder.close();
+            output.stop(); // flushes pending key-ups
+            if (!record_output_file.empty() && !output_recorder.write(record_output_file)) {
+                print_colored("Could not write " + record_output_file + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
             }
-            // --- Big Horn Pedal (Enter) HOLD logic ---
-            static bool big_horn_key_down = false;
-            if (big_horn_now && !big_horn_key_down) {
-                // Send Enter key down
-                INPUT input = {0};
-                input.type = INPUT_KEYBOARD;
-                input.ki.wVk = VK_RETURN;
-                input.ki.wScan = MapVirtualKey(VK_RETURN, MAPVK_VK_TO_VSC);
-                input.ki.dwFlags = KEYEVENTF_SCANCODE;
-                input.ki.dwExtraInfo = GetMessageExtraInfo();
-                SendInput(1, &input, sizeof(INPUT));
-                print_colored("[Big Horn Pedal] Enter DOWN\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
-                big_horn_key_down = true;
-            } else if (!big_horn_now && big_horn_key_down) {
-                // Send Enter key up
-                INPUT input = {0};
-                input.type = INPUT_KEYBOARD;
-                input.ki.wVk = VK_RETURN;
-                input.ki.wScan = MapVirtualKey(VK_RETURN, MAPVK_VK_TO_VSC);
-                input.ki.dwFlags = KEYEVENTF_SCANCODE | KEYEVENTF_KEYUP;
-                input.ki.dwExtraInfo = GetMessageExtraInfo();
-                SendInput(1, &input, sizeof(INPUT));
-                print_colored("[Big Horn Pedal] Enter UP\n", FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
-                big_horn_key_down = false;
-            }
-            // --- Small Horn Pedal (Space) HOLD logic ---
-            static bool small_horn_key_down = false;
-            if (small_horn_now && !small_horn_key_down) {
-                // Send Space key down
-                INPUT input = {0};
-                input.type = INPUT_KEYBOARD;
-                input.ki.wVk = VK_SPACE;
-                input.ki.wScan = MapVirtualKey(VK_SPACE, MAPVK_VK_TO_VSC);
-                input.ki.dwFlags = KEYEVENTF_SCANCODE;
-                input.ki.dwExtraInfo = GetMessageExtraInfo();
-                SendInput(1, &input, sizeof(INPUT));
-                print_colored("[Small Horn Pedal] Spacebar DOWN\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-                small_horn_key_down = true;
-            } else if (!small_horn_now && small_horn_key_down) {
-                // Send Space key up
-                INPUT input = {0};
-                input.type = INPUT_KEYBOARD;
-                input.ki.wVk = VK_SPACE;
-                input.ki.wScan = MapVirtualKey(VK_SPACE, MAPVK_VK_TO_VSC);
-                input.ki.dwFlags = KEYEVENTF_SCANCODE | KEYEVENTF_KEYUP;
-                input.ki.dwExtraInfo = GetMessageExtraInfo();
-                SendInput(1, &input, sizeof(INPUT));
-                print_colored("[Small Horn Pedal] Spacebar UP\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-                small_horn_key_down = false;
-            }
-            // --- Test Menu (Right Shift) logic ---
-            static bool test_menu_prev_pressed = false;
-            if (test_menu_now && !test_menu_prev_pressed) {
-                // Send Right Shift using scan code
-                INPUT input = {0};
-                input.type = INPUT_KEYBOARD;
-                input.ki.wVk = VK_RSHIFT;
-                input.ki.wScan = MapVirtualKey(VK_RSHIFT, MAPVK_VK_TO_VSC);
-                input.ki.dwFlags = KEYEVENTF_SCANCODE;
-                input.ki.dwExtraInfo = GetMessageExtraInfo();
-                SendInput(1, &input, sizeof(INPUT));
-                print_colored("[Test Menu] RightShift DOWN\n", FOREGROUND_PINK | FOREGROUND_INTENSITY);
-            } else if (!test_menu_now && test_menu_prev_pressed) {
-                // Release Right Shift
-                INPUT input = {0};
-                input.type = INPUT_KEYBOARD;
-                input.ki.wVk = VK_RSHIFT;
-                input.ki.wScan = MapVirtualKey(VK_RSHIFT, MAPVK_VK_TO_VSC);
-                input.ki.dwFlags = KEYEVENTF_SCANCODE | KEYEVENTF_KEYUP;
-                input.ki.dwExtraInfo = GetMessageExtraInfo();
-                SendInput(1, &input, sizeof(INPUT));
-                print_colored("[Test Menu] RightShift UP\n", FOREGROUND_PINK | FOREGROUND_INTENSITY);
-            }
-            test_menu_prev_pressed = test_menu_now;
-            // --- Debug Mission (Left Shift) logic ---
-            static bool debug_mission_prev_pressed = false;
-            if (debug_mission_now && !debug_mission_prev_pressed) {
-                // Send Left Shift using scan code
-                INPUT input = {0};
-                input.type = INPUT_KEYBOARD;
-                input.ki.wVk = VK_LSHIFT;
-                input.ki.wScan = MapVirtualKey(VK_LSHIFT, MAPVK_VK_TO_VSC);
-                input.ki.dwFlags = KEYEVENTF_SCANCODE;
-                input.ki.dwExtraInfo = GetMessageExtraInfo();
-                SendInput(1, &input, sizeof(INPUT));
-                print_colored("[Debug Mission] LeftShift DOWN\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
-            } else if (!debug_mission_now && debug_mission_prev_pressed) {
-                // Release Left Shift
-                INPUT input = {0};
-                input.type = INPUT_KEYBOARD;
-                input.ki.wVk = VK_LSHIFT;
-                input.ki.wScan = MapVirtualKey(VK_LSHIFT, MAPVK_VK_TO_VSC);
-                input.ki.dwFlags = KEYEVENTF_SCANCODE | KEYEVENTF_KEYUP;
-                input.ki.dwExtraInfo = GetMessageExtraInfo();
-                SendInput(1, &input, sizeof(INPUT));
-                print_colored("[Debug Mission] LeftShift UP\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
-            }
-            debug_mission_prev_pressed = debug_mission_now;
-            // ...existing code for credit button and rest of loop...
+            logger.stop();
+            flush_config_saves();
+            console().set_raw(false);
+            print_colored("Esc pressed. Exiting...\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+            input_source.close();
+            SDL_Quit();
+            return 0;
         }
-        // Credit repeat logic
-        if (config.credit_button >= 0) {
-            if (credit_pressed) {
-                auto now = std::chrono::steady_clock::now();
-                if (!credit_prev_pressed || std::chrono::duration_cast<std::chrono::milliseconds>(now - last_credit_time).count() >= 50) {
-                    // Send [ key (VK_OEM_4) using scan code
-                    INPUT input = {0};
-                    input.type = INPUT_KEYBOARD;
-                    input.ki.wVk = VK_OEM_4;
-                    input.ki.wScan = MapVirtualKey(VK_OEM_4, MAPVK_VK_TO_VSC);
-                    input.ki.dwFlags = KEYEVENTF_SCANCODE;
-                    input.ki.dwExtraInfo = GetMessageExtraInfo();
-                    SendInput(1, &input, sizeof(INPUT));
-                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
-                    input.ki.dwFlags = KEYEVENTF_SCANCODE | KEYEVENTF_KEYUP;
-                    SendInput(1, &input, sizeof(INPUT));
-                    print_colored("[Credit] [ key sent\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-                    last_credit_time = now;
+        // Settings menu hotkey: Tab
+        if (action == HOTKEY_SETTINGS) {
+            reloader.pause();
+            pause_input_thread(input_ctl, *source);
+            console().set_raw(false);
+            logger.flush();
+            clear_screen();
+            print_colored("\nTab pressed. Opening settings menu...\n", FOREGROUND_LIME);
+            settings_menu(config, "mascon_translator.cfg", mode, selected_id);
+            lang = config.language; // Update language after settings menu
+            translator.load(config, mode, lang); // Profile or mappings may have changed
+            logger.set_language(lang);
+            flush_config_saves(); // our own saves are not external edits
+            reloader.watch(profile_filename(config));
+            profile_switcher.reset(config);
+            if (selected_id != joy_index || (!config.joystick_guid.empty() && config.joystick_guid != input_source.guid())) {
+                int opened = input_source.open(config.joystick_guid, selected_id);
+                if (opened >= 0) {
+                    joy_index = selected_id = opened;
+                } else if (config.joystick_guid.empty()) {
+                    print_colored(tr("Failed to open joystick.", lang) + "\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
+                    selected_id = joy_index;
                 }
-                credit_prev_pressed = true;
-            } else {
-                credit_prev_pressed = false;
-            }
-        }
-        if (fgWnd == consoleWnd || fgWnd == parentWnd) {
-            if (GetAsyncKeyState(VK_ESCAPE) & 0x8000) {
-                print_colored("Esc pressed. Exiting...\n", FOREGROUND_RED | FOREGROUND_INTENSITY);
-                SDL_JoystickClose(joy);
-                SDL_Quit();
-                return 0;
             }
-            // Settings menu hotkey: Tab
-            if (GetAsyncKeyState(VK_TAB) & 0x8000) {
-                system("cls");
-                print_colored("\nTab pressed. Opening settings menu...\n", FOREGROUND_LIME);
-                settings_menu(config, "mascon_translator.cfg", mode, selected_id, num_joysticks);
-                lang = config.language; // Update language after settings menu
-                // Refresh header after returning from settings
-                system("cls");
-                print_colored("=================================\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-                print_colored("  Mascon Lever Input Translator\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-                print_colored("=================================\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-                std::cout << "Using joystick #";
-                print_colored(std::to_string(selected_id), FOREGROUND_PINK | FOREGROUND_INTENSITY);
-                std::cout << ": ";
-                std::cout << SDL_JoystickNameForIndex(selected_id);
-                std::cout << std::endl;
-                std::cout << "Output mode: ";
-                print_colored((mode == 0 ? tr("Up/Down Arrow Keys", lang) : tr("Mouse Scroll", lang)), FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
-                std::cout << std::endl;
-                std::cout << "---------------------------------\n";
-                std::cout << tr("Press ", lang);
-                print_colored(tr("Tab", lang), FOREGROUND_LIME);
-                std::cout << tr(" to open settings menu.", lang) << std::endl;
-                std::cout << tr("Press ", lang);
-                print_colored(tr("Esc", lang), FOREGROUND_RED | FOREGROUND_INTENSITY);
-                std::cout << tr(" to exit.", lang) << std::endl;
-                std::cout << "---------------------------------\n";
-                print_colored("Input translation is active! Move the lever to send input ^w^\n\n", FOREGROUND_PINK | FOREGROUND_INTENSITY);
-                std::this_thread::sleep_for(std::chrono::milliseconds(300)); // debounce
-            }
-        }
-        // Lever/arrow/mouse logic should always run, regardless of focus
-        SDL_JoystickUpdate();
-        pressed.clear();
-        int num_buttons = SDL_JoystickNumButtons(joy);
-        for (int i = 0; i < num_buttons; ++i) {
-            if (SDL_JoystickGetButton(joy, i)) {
-                pressed.insert(i);
-            }
-        }
-        int idx = match_combo(pressed, ordered_combos);
-        if (mode == 2 && idx >= 0 && idx < 15) {
-            int vk = config.lever_keycodes[idx];
-            if (vk > 0) {
-                // Send the key as a press and release
-                INPUT input = {0};
-                input.type = INPUT_KEYBOARD;
-                input.ki.wVk = vk;
-                input.ki.dwFlags = 0;
-                SendInput(1, &input, sizeof(INPUT));
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));
-                input.ki.dwFlags = KEYEVENTF_KEYUP;
-                SendInput(1, &input, sizeof(INPUT));
-                print_colored("[Lever-to-Key] Sent key VK=0x" + std::to_string(vk) + "\n", COLOR_PINK);
-                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            if (config.extra_joysticks != extra_devices) {
+                extra_devices = config.extra_joysticks;
+                input_source.set_extra_devices(split_words(extra_devices));
             }
-            continue;
+            // Refresh header after returning from settings
+            clear_screen();
+            print_colored("=================================\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            print_colored("  Mascon Lever Input Translator\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            print_colored("=================================\n", FOREGROUND_GREEN | FOREGROUND_INTENSITY);
+            std::cout << "Using joystick #";
+            print_colored(std::to_string(selected_id), FOREGROUND_PINK | FOREGROUND_INTENSITY);
+            std::cout << ": ";
+            std::cout << SDL_JoystickNameForIndex(selected_id);
+            std::cout << std::endl;
+            std::cout << "Output mode: ";
+            print_colored((mode == 0 ? tr(TR_KEY("Up/Down Arrow Keys"), lang) : tr(TR_KEY("Mouse Scroll"), lang)), FOREGROUND_YELLOW | FOREGROUND_INTENSITY);
+            std::cout << std::endl;
+            std::cout << "---------------------------------\n";
+            std::cout << tr(TR_KEY("Press "), lang);
+            print_colored(tr(TR_KEY("Tab"), lang), FOREGROUND_LIME);
+            std::cout << tr(TR_KEY(" to open settings menu."), lang) << std::endl;
+            std::cout << tr(TR_KEY("Press "), lang);
+            print_colored(tr(TR_KEY("Esc"), lang), FOREGROUND_RED | FOREGROUND_INTENSITY);
+            std::cout << tr(TR_KEY(" to exit."), lang) << std::endl;
+            std::cout << "---------------------------------\n";
+            print_colored("Input translation is active! Move the lever to send input ^w^\n\n", FOREGROUND_PINK | FOREGROUND_INTENSITY);
+            std::this_thread::sleep_for(std::chrono::milliseconds(300)); // debounce
+            console().set_raw(true);
+            resume_input_thread(input_ctl);
         }
-        auto now = std::chrono::steady_clock::now();
-        if (idx != stable_idx) {
-            stable_idx = idx;
-            last_event_time = now;
+        // The translator already switched; keep our copy in step so the
+        // settings menu starts from the edited file
+        Config reloaded;
+        if (reloader.take(reloaded)) {
+            reloaded.language = config.language; // language changes go through the settings menu
+            config = reloaded;
+            profile_switcher.update(config);
         }
-        // Debounce logic: Only config.debounce_ms is used for debounce timing.
-        // up_down_delay_ms and mouse_scroll_delay_ms are NOT used for debounce.
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_event_time).count();
-        if (idx != -1 && idx != last_idx && elapsed >= config.debounce_ms) {
-            if (last_idx != -1) {
-                int diff = idx - last_idx;
-                // Only move one step per debounce period for consistent timing
-                int step = (diff > 0) ? 1 : -1;
-                int next_idx = last_idx + step;
-                if (mode == 0) {
-                    sendArrowKey((step > 0) ? VK_DOWN : VK_UP, config.key_hold_time_ms);
-                    std::this_thread::sleep_for(std::chrono::milliseconds(config.up_down_delay_ms));
-                } else if (mode == 1) {
-                    sendMouseScroll((step > 0) ? -120 : 120);
-                    std::this_thread::sleep_for(std::chrono::milliseconds(config.mouse_scroll_delay_ms));
-                }
-                print_colored(names[last_idx] + " -> " + names[next_idx] + " : ", (step > 0) ? (FOREGROUND_YELLOW | FOREGROUND_INTENSITY) : (FOREGROUND_CYAN | FOREGROUND_INTENSITY));
-                print_colored((step > 0) ? "v" : "^", (step > 0) ? (FOREGROUND_GREEN | FOREGROUND_INTENSITY) : (FOREGROUND_PINK | FOREGROUND_INTENSITY));
-                std::cout << std::endl;
-                last_idx = next_idx;
-            } else if (idx == 9) {
-                print_colored(tr("Neutral position!", lang) + "\n", FOREGROUND_PINK | FOREGROUND_INTENSITY);
-                last_idx = idx;
+        // Per-game profiles from profile_rules.txt follow the focused window
+        if (profile_switcher.poll(config)) reloader.watch(profile_filename(config));
+        if (Clock::now() - last_title_update >= std::chrono::seconds(1)) {
+            last_title_update = Clock::now();
+            const LatencyHistogram& total = latency_stats.hist[mode == 1 ? LAT_SCROLL : mode == 2 ? LAT_LEVER_KEY : LAT_ARROW][LAT_TOTAL];
+            if (total.count() != last_title_count) {
+                last_title_count = total.count();
+                std::string title = "Mascon Lever Input Translator - latency p50 " + format_us(total.percentile(50)) + " ms, p99 " +
+                                    format_us(total.percentile(99)) + " ms, max " + format_us(total.max()) + " ms";
+                console().set_title(title);
             }
-            last_event_time = std::chrono::steady_clock::now();
         }
-        last_pressed = pressed;
-        // No sleep for high-frequency polling
+        // Hotkeys are human-speed; no need to spin here
+        std::this_thread::sleep_for(std::chrono::milliseconds(HOTKEY_POLL_MS));
     }
-    SDL_JoystickClose(joy);
-    SDL_Quit();
-    return 0;
 }
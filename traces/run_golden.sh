@@ -0,0 +1,16 @@
+#!/bin/sh
+# Replays every trace in this directory and its subdirectories and checks it
+# against its golden file (trace.mltr -> trace.txt). Each directory has its
+# own mascon_translator.cfg (lever_filter/ turns the glitch filter on), so
+# the results do not depend on your own profile.
+# Usage: traces/run_golden.sh [path to mascon_translator]
+bin=$(cd "$(dirname "${1:-./mascon_translator}")" && pwd)/$(basename "${1:-./mascon_translator}")
+cd "$(dirname "$0")" || exit 1
+failed=0
+for dir in ./ */; do
+    for trace in "$dir"*.mltr; do
+        [ -f "$trace" ] || continue
+        (cd "$dir" && "$bin" --golden "$(basename "$trace")" "$(basename "${trace%.mltr}").txt" --mode 0) || failed=1
+    done
+done
+exit $failed